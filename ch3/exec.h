@@ -0,0 +1,345 @@
+#include "parser.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef _EXEC_H
+#define _EXEC_H 1
+
+extern char** environ;
+
+// a command the shell runs itself rather than exec-ing; in a pipeline it
+// runs in a forked child
+struct __builtin
+{
+  const char* name;
+  int (*run)(char** args);
+};
+
+// launch external commands with posix_spawn (0: fork + exec every stage)
+static char __use_spawn = 1;
+
+// signals a job-controlling shell ignores, which its jobs must not
+static const int __job_signals[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU };
+
+#define __N_JOB_SIGNALS (sizeof(__job_signals) / sizeof(*__job_signals))
+
+void
+dup_file_fd(const char* file, const char* file_mode, int io_fd)
+{
+  // open file
+  FILE* in_file = fopen(file, file_mode);
+  if (in_file == NULL) {
+    perror("open file");
+    _exit(EXIT_FAILURE);
+  }
+  // dup file fd
+  if (dup2(fileno(in_file), io_fd) == -1) {
+    perror("dup2 file");
+    _exit(EXIT_FAILURE);
+  }
+  // close file fd
+  if (close(fileno(in_file)) != 0) {
+    perror("close file");
+    _exit(EXIT_FAILURE);
+  }
+}
+
+int*
+__init_pipes(int total_proc)
+{
+  int* pipes = NULL;
+  int n_pipes = total_proc - 1;
+  if (n_pipes > 0) {
+    pipes = (int*)malloc(sizeof(int) * n_pipes * 2);
+    if (pipes == NULL) {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  // create pipes: [r/w r/w r/w ...]; close-on-exec, so a spawned
+  // child keeps only the ends it dups onto stdin / stdout
+  int n;
+  int* p = pipes;
+  for (n = 0; n < n_pipes; n++) {
+    if (pipe(p) < 0) {
+      perror("failure creating pipe");
+      exit(EXIT_FAILURE);
+    }
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+    fcntl(p[1], F_SETFD, FD_CLOEXEC);
+    p += 2;
+  }
+  return pipes;
+}
+
+void
+__close_pipes(const int* pipes, int total_proc)
+{
+  int n;
+  int n_pipes = (total_proc - 1) * 2;
+  for (n = 0; n < n_pipes; n++) {
+    if (close(*pipes) != 0) {
+      perror("error close");
+      _exit(EXIT_FAILURE);
+    }
+    pipes++;
+  }
+}
+
+static inline const int*
+__get_pipe(const int* pipes, int n_proc, int total_proc, char read)
+{
+  const int* read_pos = pipes + (n_proc - 1) * 2;
+  const int* write_pos = read_pos + 3;
+  char can_read = 1 <= n_proc && n_proc <= (total_proc - 1);
+  char can_write = 0 <= n_proc && n_proc <= (total_proc - 2);
+  size_t readable = read && can_read;
+  size_t writable = !read && can_write;
+  return (int*)(readable * (size_t)read_pos + writable * (size_t)write_pos);
+}
+
+void
+dup_pipe(const int* pipes, int n_proc, int total_proc, char read, int io_fd)
+{
+  // use pipe as stdin
+  const int* p = __get_pipe(pipes, n_proc, total_proc, read);
+  if (p != NULL) {
+    if (dup2(*p, io_fd) == -1) {
+      perror("dup2 pipe");
+      _exit(EXIT_FAILURE);
+    }
+  }
+}
+
+void
+__fork_child(struct __command* cmd,
+             const struct __builtin* builtin,
+             const int* pipes,
+             int n_proc,
+             int total_proc,
+             pid_t* pids,
+             pid_t* pgid)
+{
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    // join the job's process group, with its signals back to default
+    if (pgid != NULL) {
+      size_t n;
+      setpgid(0, *pgid);
+      for (n = 0; n < __N_JOB_SIGNALS; n++) {
+        signal(__job_signals[n], SIG_DFL);
+      }
+    }
+    // dup fd to stdin / stdout
+    if (cmd->_in_file != NULL) {
+      dup_file_fd(cmd->_in_file, "r", STDIN_FILENO);
+    } else {
+      dup_pipe(pipes, n_proc, total_proc, 1, STDIN_FILENO);
+    }
+    if (cmd->_out_file != NULL) {
+      dup_file_fd(cmd->_out_file, "w", STDOUT_FILENO);
+    } else {
+      dup_pipe(pipes, n_proc, total_proc, 0, STDOUT_FILENO);
+    }
+    // close all pipes fd after dup
+    __close_pipes(pipes, total_proc);
+    // builtin; what the shell has read ahead of stdin is not its input
+    if (builtin != NULL) {
+      __stdin_reader._pos = __stdin_reader._end;
+      int code = builtin->run(cmd->args);
+      fflush(stdout);
+      _exit(code);
+    }
+    // execv
+    int code = execvp(*cmd->args, cmd->args);
+    perror("exec");
+    _exit(code);
+  } else {
+    // parent: record pid; set the group here too, so it is in place
+    // whichever process gets to run first
+    if (pgid != NULL) {
+      if (*pgid == 0) {
+        *pgid = pid;
+      }
+      setpgid(pid, *pgid);
+    }
+    pids[n_proc] = pid;
+  }
+}
+
+// launch an external command without copying the shell's page tables:
+// the pipe dups and redirections are posix_spawn file actions. The
+// redirected files are opened here, so a missing file is reported as
+// such rather than as a failed exec. The process group and signal
+// defaults are spawn attributes.
+void
+__spawn_child(struct __command* cmd,
+              const int* pipes,
+              int n_proc,
+              int total_proc,
+              pid_t* pids,
+              pid_t* pgid)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  int in_fd = -1, out_fd = -1;
+  const int* p;
+  pid_t pid = -1;
+  int err;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+  if (pgid != NULL) {
+    sigset_t defaults;
+    size_t n;
+    sigemptyset(&defaults);
+    for (n = 0; n < __N_JOB_SIGNALS; n++) {
+      sigaddset(&defaults, __job_signals[n]);
+    }
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setpgroup(&attr, *pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF);
+  }
+  // dup fd to stdin / stdout
+  if (cmd->_in_file != NULL) {
+    if ((in_fd = open(cmd->_in_file, O_RDONLY | O_CLOEXEC)) < 0) {
+      perror("open file");
+      goto done;
+    }
+    posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+  } else if ((p = __get_pipe(pipes, n_proc, total_proc, 1)) != NULL) {
+    posix_spawn_file_actions_adddup2(&actions, *p, STDIN_FILENO);
+  }
+  if (cmd->_out_file != NULL) {
+    out_fd =
+      open(cmd->_out_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out_fd < 0) {
+      perror("open file");
+      goto done;
+    }
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+  } else if ((p = __get_pipe(pipes, n_proc, total_proc, 0)) != NULL) {
+    posix_spawn_file_actions_adddup2(&actions, *p, STDOUT_FILENO);
+  }
+  // the pipes and files themselves are close-on-exec
+
+  err = posix_spawnp(&pid, *cmd->args, &actions, &attr, cmd->args, environ);
+  if (err != 0) {
+    errno = err;
+    perror("exec");
+    pid = -1;
+  } else if (pgid != NULL && *pgid == 0) {
+    *pgid = pid;
+  }
+
+done:
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  if (in_fd >= 0) {
+    close(in_fd);
+  }
+  if (out_fd >= 0) {
+    close(out_fd);
+  }
+  // record pid
+  pids[n_proc] = pid;
+}
+
+// the builtin named by args[0], if any
+static inline const struct __builtin*
+__find_builtin(const struct __builtin* builtins, const char* name)
+{
+  if (builtins == NULL) {
+    return NULL;
+  }
+  for (; builtins->name != NULL; builtins++) {
+    if (strcmp(builtins->name, name) == 0) {
+      return builtins;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Start every command of a pipeline, each stage's stdout piped into the
+ * next one's stdin, storing each stage's pid in pids, or -1 if it could
+ * not be started. External commands are spawned; builtins (from the
+ * NULL-terminated builtins table, which may be NULL) are forked.
+ *
+ * With pgid not NULL the stages share a process group: a new one if
+ * *pgid is 0, whose id is stored there, or else *pgid.
+ */
+void
+__launch(struct __parse_result* command,
+         const struct __builtin* builtins,
+         pid_t* pids,
+         pid_t* pgid)
+{
+  int total_proc = __VEC_LEN(command->commands);
+
+  // alloc / open pipes
+  int* pipes = __init_pipes(total_proc);
+
+  // launch child processes
+  struct __command* cmd;
+  int n_proc = 0;
+  for (cmd = command->commands._start; cmd < command->commands._end; cmd++) {
+    const struct __builtin* builtin = __find_builtin(builtins, *cmd->args);
+    if (builtin == NULL && __use_spawn) {
+      __spawn_child(cmd, pipes, n_proc, total_proc, pids, pgid);
+    } else {
+      __fork_child(cmd, builtin, pipes, n_proc, total_proc, pids, pgid);
+    }
+    n_proc++;
+  }
+
+  // close all pipes after finished forking
+  __close_pipes(pipes, total_proc);
+  free(pipes);
+}
+
+/**
+ * Run a pipeline in the shell's own process group and wait for it
+ * unless in background; background stages are left for the caller to
+ * reap.
+ */
+void
+__exec(struct __parse_result* command, const struct __builtin* builtins)
+{
+  int total_proc = __VEC_LEN(command->commands);
+
+  // pids
+  pid_t* pids = (pid_t*)malloc(sizeof(pid_t) * total_proc);
+  if (pids == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+
+  __launch(command, builtins, pids, NULL);
+
+  // wait for finish
+  if (!command->background) {
+    int status = 0;
+    int n;
+    for (n = 0; n < total_proc; n++) {
+      if (pids[n] > 0) {
+        waitpid(pids[n], &status, 0);
+      }
+    }
+  }
+
+  // free memory
+  free(pids);
+}
+
+#endif
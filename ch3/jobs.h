@@ -0,0 +1,802 @@
+#include "exec.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifndef _JOBS_H
+#define _JOBS_H 1
+
+// state of one stage of a job
+#define __STAGE_RUNNING 0
+#define __STAGE_STOPPED 1
+#define __STAGE_GONE 2 // reaped, or never started
+
+// a launched pipeline, kept until it is done and reported
+struct __job
+{
+  int id;       // the n of %n
+  pid_t pgid;   // its process group, 0 without job control
+  pid_t* pids;  // every stage's pid, -1 if it could not be started
+  char* states; // every stage's __STAGE_*
+  int n_procs;
+  int n_live;      // stages not yet reaped
+  int status;      // wait status of the last stage
+  char background; // to be reported when done
+  char* text;      // the command line, for `jobs`
+};
+
+struct __vec_job
+{
+  struct __job* _start;
+  struct __job* _end;
+  struct __job* _mem_end;
+};
+
+// a pid and the id of its job; pid 0 is an empty slot
+struct __pid_slot
+{
+  pid_t pid;
+  int job;
+};
+
+// jobs in order of id
+static struct __vec_job __jobs = { NULL, NULL, NULL };
+
+// index of the first done job that can be removed, if any
+static size_t __first_done = (size_t)-1;
+
+// open addressing table from the pid of every live stage to its job,
+// so reaping is O(1) however many jobs there are; size is a power of two
+static struct __pid_slot* __pid_table = NULL;
+static size_t __pid_table_size = 0;
+static size_t __pid_count = 0;
+
+// job control: the shell owns the terminal and each job gets its own
+// process group; only when stdin is a terminal
+static char __interactive = 0;
+static pid_t __shell_pgid = 0;
+
+// SIGCHLD writes a byte here, so the main loop can poll for it
+static int __sigchld_pipe[2] = { -1, -1 };
+static pid_t __sigchld_pipe_owner = 0;
+
+// the shell's builtins, which jobs may run too
+static const struct __builtin* __job_builtins = NULL;
+
+static inline size_t
+__pid_slot_of(pid_t pid)
+{
+  return ((size_t)pid * 0x9e3779b97f4a7c15ULL) & (__pid_table_size - 1);
+}
+
+// double the pid table
+static void
+__pid_table_grow(void)
+{
+  size_t old_size = __pid_table_size;
+  struct __pid_slot* old = __pid_table;
+  size_t n;
+  __pid_table_size = old_size ? old_size * 2 : 256;
+  __pid_table = (struct __pid_slot*)calloc(__pid_table_size, sizeof(*old));
+  if (__pid_table == NULL) {
+    perror("calloc");
+    exit(EXIT_FAILURE);
+  }
+  for (n = 0; n < old_size; n++) {
+    if (old[n].pid != 0) {
+      size_t i = __pid_slot_of(old[n].pid);
+      while (__pid_table[i].pid != 0) {
+        i = (i + 1) & (__pid_table_size - 1);
+      }
+      __pid_table[i] = old[n];
+    }
+  }
+  free(old);
+}
+
+static void
+__pid_table_insert(pid_t pid, int job)
+{
+  size_t i;
+  // keep the table at most half full
+  if (2 * (__pid_count + 1) > __pid_table_size) {
+    __pid_table_grow();
+  }
+  i = __pid_slot_of(pid);
+  while (__pid_table[i].pid != 0) {
+    i = (i + 1) & (__pid_table_size - 1);
+  }
+  __pid_table[i].pid = pid;
+  __pid_table[i].job = job;
+  __pid_count++;
+}
+
+// remove pid, returning its job id, or -1 if it is not a job's
+static int
+__pid_table_remove(pid_t pid)
+{
+  size_t mask = __pid_table_size - 1;
+  size_t i, j;
+  int job;
+  if (__pid_table_size == 0) {
+    return -1;
+  }
+  for (i = __pid_slot_of(pid); __pid_table[i].pid != pid; i = (i + 1) & mask) {
+    if (__pid_table[i].pid == 0) {
+      return -1;
+    }
+  }
+  job = __pid_table[i].job;
+  // shift back later slots that would no longer be found past the hole
+  for (j = (i + 1) & mask; __pid_table[j].pid != 0; j = (j + 1) & mask) {
+    size_t home = __pid_slot_of(__pid_table[j].pid);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      __pid_table[i] = __pid_table[j];
+      i = j;
+    }
+  }
+  __pid_table[i].pid = 0;
+  __pid_count--;
+  return job;
+}
+
+// pid's job id, or -1
+static int
+__pid_table_find(pid_t pid)
+{
+  size_t i;
+  if (__pid_table_size == 0) {
+    return -1;
+  }
+  for (i = __pid_slot_of(pid); __pid_table[i].pid != 0;
+       i = (i + 1) & (__pid_table_size - 1)) {
+    if (__pid_table[i].pid == pid) {
+      return __pid_table[i].job;
+    }
+  }
+  return -1;
+}
+
+// the job with this id, or NULL
+static struct __job*
+__job_by_id(int id)
+{
+  struct __job* low = __jobs._start;
+  struct __job* high = __jobs._end;
+  while (low < high) {
+    struct __job* mid = low + (high - low) / 2;
+    if (mid->id < id) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low < __jobs._end && low->id == id ? low : NULL;
+}
+
+static inline char
+__job_stopped(const struct __job* job)
+{
+  int n;
+  if (job->n_live == 0) {
+    return 0;
+  }
+  for (n = 0; n < job->n_procs; n++) {
+    if (job->states[n] == __STAGE_RUNNING) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// the exit code of a wait status
+static inline int
+__status_code(int status)
+{
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
+
+static void
+__on_sigchld(int sig)
+{
+  int saved = errno;
+  (void)sig;
+  // a full pipe already has a wakeup in it
+  if (write(__sigchld_pipe[1], "", 1) < 0) {
+  }
+  errno = saved;
+}
+
+// give this process a SIGCHLD pipe of its own; a builtin forked into a
+// pipeline must not share the shell's, or either could take the other's
+// wakeups
+void
+__init_sigchld(void)
+{
+  struct sigaction action;
+  int n;
+  if (__sigchld_pipe_owner == getpid()) {
+    return;
+  }
+  for (n = 0; n < 2; n++) {
+    if (__sigchld_pipe[n] >= 0) {
+      close(__sigchld_pipe[n]);
+    }
+  }
+  if (pipe(__sigchld_pipe) < 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  for (n = 0; n < 2; n++) {
+    fcntl(__sigchld_pipe[n], F_SETFD, FD_CLOEXEC);
+    fcntl(__sigchld_pipe[n], F_SETFL, O_NONBLOCK);
+  }
+  __sigchld_pipe_owner = getpid();
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = __on_sigchld;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGCHLD, &action, NULL);
+}
+
+// set up reaping, and job control if stdin is a terminal; builtins is
+// the shell's table, which jobs may run from too
+void
+__init_jobs(const struct __builtin* builtins)
+{
+  __job_builtins = builtins;
+  __init_sigchld();
+
+  __interactive = isatty(STDIN_FILENO);
+  if (__interactive) {
+    size_t s;
+    // wait to be put in the foreground
+    while (tcgetpgrp(STDIN_FILENO) != (__shell_pgid = getpgrp())) {
+      kill(-__shell_pgid, SIGTTIN);
+    }
+    for (s = 0; s < __N_JOB_SIGNALS; s++) {
+      signal(__job_signals[s], SIG_IGN);
+    }
+    // a session leader already leads its group
+    setpgid(0, 0);
+    __shell_pgid = getpgrp();
+    tcsetpgrp(STDIN_FILENO, __shell_pgid);
+  }
+}
+
+// a done job can be removed once reported: at the next prompt when
+// interactive, otherwise by `jobs` or `wait`, as a script may still
+// `wait` for it
+static inline char
+__job_removable(const struct __job* job)
+{
+  return job->n_live == 0 && (__interactive || !job->background);
+}
+
+static inline void
+__job_check_done(const struct __job* job)
+{
+  if (__job_removable(job) && (size_t)(job - __jobs._start) < __first_done) {
+    __first_done = job - __jobs._start;
+  }
+}
+
+// a job reported by `jobs` or `wait` needs no report at the prompt
+static inline void
+__job_reported(struct __job* job)
+{
+  job->background = 0;
+  __job_check_done(job);
+}
+
+// record what waitpid said about pid; foreground is the job the
+// terminal was handed to, if any
+static void
+__reap(pid_t pid, int status, const struct __job* foreground)
+{
+  int id, n;
+  struct __job* job;
+  if (WIFSTOPPED(status) || WIFCONTINUED(status)) {
+    id = __pid_table_find(pid);
+  } else {
+    id = __pid_table_remove(pid);
+  }
+  if (id < 0 || (job = __job_by_id(id)) == NULL) {
+    return;
+  }
+  for (n = 0; job->pids[n] != pid; n++) {
+  }
+
+  if (WIFSTOPPED(status)) {
+    // a stage that touched the terminal before it was handed over
+    if (job == foreground && (WSTOPSIG(status) == SIGTTIN ||
+                              WSTOPSIG(status) == SIGTTOU)) {
+      kill(pid, SIGCONT);
+    } else {
+      job->states[n] = __STAGE_STOPPED;
+    }
+  } else if (WIFCONTINUED(status)) {
+    job->states[n] = __STAGE_RUNNING;
+  } else {
+    job->states[n] = __STAGE_GONE;
+    if (n == job->n_procs - 1) {
+      job->status = status;
+    }
+    job->n_live--;
+    __job_check_done(job);
+  }
+}
+
+// reap every child that has exited, stopped or continued, without
+// blocking
+void
+__reap_jobs(void)
+{
+  pid_t pid;
+  int status;
+  while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+    __reap(pid, status, NULL);
+  }
+}
+
+// wait until the job is done or stopped, reaping whatever else exits
+static void
+__wait_job(struct __job* job, const struct __job* foreground)
+{
+  while (job->n_live > 0 && !__job_stopped(job)) {
+    int status;
+    pid_t pid = waitpid(-1, &status, WUNTRACED | WCONTINUED);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != ECHILD) {
+        perror("waitpid");
+      }
+      return;
+    }
+    __reap(pid, status, foreground);
+  }
+}
+
+// reap the children SIGCHLD has announced, without blocking
+static void
+__reap_signalled(void)
+{
+  char drain[256];
+  char signalled = 0;
+  while (read(__sigchld_pipe[0], drain, sizeof(drain)) > 0) {
+    signalled = 1;
+  }
+  if (signalled) {
+    __reap_jobs();
+  }
+}
+
+// block until a line can be read, reaping children as they exit; lines
+// already read in a block need no waiting, but children are reaped
+// before every line all the same
+void
+__wait_input(void)
+{
+  struct pollfd fds[2] = {
+    { STDIN_FILENO, POLLIN, 0 },
+    { __sigchld_pipe[0], POLLIN, 0 },
+  };
+  __reap_signalled();
+  while (__stdin_reader._pos == __stdin_reader._end) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      exit(EXIT_FAILURE);
+    }
+    if (fds[1].revents & POLLIN) {
+      __reap_signalled();
+    }
+    if (fds[0].revents != 0) {
+      break;
+    }
+  }
+}
+
+// how a job is doing, as `jobs` puts it
+static const char*
+__job_state_name(const struct __job* job, char* buf, size_t size)
+{
+  if (job->n_live > 0) {
+    return __job_stopped(job) ? "Stopped" : "Running";
+  }
+  if (WIFSIGNALED(job->status)) {
+    return strsignal(WTERMSIG(job->status));
+  }
+  if (WEXITSTATUS(job->status) != 0) {
+    snprintf(buf, size, "Exit %d", WEXITSTATUS(job->status));
+    return buf;
+  }
+  return "Done";
+}
+
+// print one line of `jobs`; the last job is the current one (+), the
+// one before it the previous (-)
+static void
+__print_job(FILE* out, const struct __job* job)
+{
+  char buf[32];
+  char mark = job == __jobs._end - 1 ? '+' : job == __jobs._end - 2 ? '-' : ' ';
+  fprintf(out,
+          "[%d]%c  %-24s%s%s\n",
+          job->id,
+          mark,
+          __job_state_name(job, buf, sizeof(buf)),
+          job->text,
+          job->background && job->n_live > 0 && !__job_stopped(job) ? " &"
+                                                                     : "");
+}
+
+static void
+__free_job(struct __job* job)
+{
+  free(job->pids);
+  free(job->states);
+  free(job->text);
+}
+
+// report background jobs that have finished since the last prompt, and
+// forget every finished job that has been reported
+void
+__notify_jobs(void)
+{
+  struct __job* job;
+  struct __job* kept;
+  if (__first_done == (size_t)-1) {
+    return;
+  }
+  kept = __jobs._start + __first_done;
+  for (job = kept; job < __jobs._end; job++) {
+    if (!__job_removable(job)) {
+      *(kept++) = *job;
+      continue;
+    }
+    if (__interactive && job->background) {
+      __print_job(stdout, job);
+    }
+    __free_job(job);
+  }
+  __jobs._end = kept;
+  __first_done = (size_t)-1;
+  fflush(stdout);
+}
+
+// add a job for a pipeline about to be launched
+static struct __job*
+__add_job(const struct __parse_result* command)
+{
+  struct __job job;
+  struct __parse_result shown = *command;
+  size_t text_size;
+  FILE* text;
+  int n;
+
+  job.id = __jobs._end > __jobs._start ? (__jobs._end - 1)->id + 1 : 1;
+  job.pgid = 0;
+  job.n_procs = __VEC_LEN(command->commands);
+  job.n_live = 0;
+  // a stage that could not be started counts as exiting 127
+  job.status = 127 << 8;
+  job.background = command->background;
+  __CHECKED_MALLOC(job.pids, job.n_procs);
+  __CHECKED_MALLOC(job.states, job.n_procs);
+  for (n = 0; n < job.n_procs; n++) {
+    job.pids[n] = -1;
+    job.states[n] = __STAGE_GONE;
+  }
+
+  // the command line without " &" or the newline
+  shown.background = 0;
+  if ((text = open_memstream(&job.text, &text_size)) == NULL) {
+    perror("open_memstream");
+    exit(EXIT_FAILURE);
+  }
+  __fprint_parsed(text, &shown);
+  fclose(text);
+  if (text_size > 0) {
+    job.text[text_size - 1] = '\0';
+  }
+
+  __VEC_RESERVE(__jobs, 1);
+  *(__jobs._end++) = job;
+  return __jobs._end - 1;
+}
+
+// send SIGCONT to every live stage of a job
+static void
+__continue_job(struct __job* job)
+{
+  int n;
+  if (job->pgid > 0) {
+    kill(-job->pgid, SIGCONT);
+  }
+  for (n = 0; n < job->n_procs; n++) {
+    if (job->states[n] == __STAGE_STOPPED) {
+      if (job->pgid <= 0) {
+        kill(job->pids[n], SIGCONT);
+      }
+      job->states[n] = __STAGE_RUNNING;
+    }
+  }
+}
+
+// run a job in the foreground, continuing it first if cont, until it
+// is done or stopped; returns its exit code
+static int
+__foreground(struct __job* job, char cont)
+{
+  job->background = 0;
+  if (__interactive && job->pgid > 0) {
+    tcsetpgrp(STDIN_FILENO, job->pgid);
+  }
+  if (cont) {
+    __continue_job(job);
+  }
+  __wait_job(job, job);
+  if (__interactive) {
+    tcsetpgrp(STDIN_FILENO, __shell_pgid);
+  }
+  if (__job_stopped(job)) {
+    job->background = 1;
+    printf("\n");
+    __print_job(stdout, job);
+    fflush(stdout);
+    return 128 + SIGTSTP;
+  }
+  if (__interactive && WIFSIGNALED(job->status)) {
+    // the ^C echoed by the terminal needs a newline after it
+    if (WTERMSIG(job->status) == SIGINT) {
+      printf("\n");
+    } else if (WTERMSIG(job->status) != SIGPIPE) {
+      printf("%s\n", strsignal(WTERMSIG(job->status)));
+    }
+  }
+  return __status_code(job->status);
+}
+
+// open file onto io_fd, returning a copy of what io_fd was, or -1
+static int
+__redirect_builtin(const char* file, int flags, int io_fd)
+{
+  int saved;
+  int fd = open(file, flags | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    perror("open file");
+    return -1;
+  }
+  saved = fcntl(io_fd, F_DUPFD_CLOEXEC, 10);
+  dup2(fd, io_fd);
+  close(fd);
+  return saved;
+}
+
+static void
+__restore_fd(int saved, int io_fd)
+{
+  if (saved >= 0) {
+    dup2(saved, io_fd);
+    close(saved);
+  }
+}
+
+// whether this is the shell controlling the terminal, and not a
+// builtin forked into a pipeline
+static inline char
+__job_control(void)
+{
+  return __interactive && getpgrp() == __shell_pgid;
+}
+
+// run a builtin in the shell itself, so it can see and change the jobs;
+// with its stdin redirected, it reads the file rather than what the
+// shell has read ahead
+static int
+__run_builtin(struct __command* cmd, const struct __builtin* builtin)
+{
+  int saved_in = -1, saved_out = -1;
+  struct __block_reader saved_reader = __stdin_reader;
+  struct __block_reader file_reader = __READER_INIT(STDIN_FILENO);
+  int code;
+  fflush(stdout);
+  if (cmd->_in_file != NULL) {
+    if ((saved_in = __redirect_builtin(cmd->_in_file, O_RDONLY, STDIN_FILENO)) <
+        0) {
+      return EXIT_FAILURE;
+    }
+    __stdin_reader = file_reader;
+  }
+  if (cmd->_out_file != NULL &&
+      (saved_out = __redirect_builtin(
+         cmd->_out_file, O_WRONLY | O_CREAT | O_TRUNC, STDOUT_FILENO)) < 0) {
+    __restore_fd(saved_in, STDIN_FILENO);
+    return EXIT_FAILURE;
+  }
+  code = builtin->run(cmd->args);
+  fflush(stdout);
+  if (cmd->_in_file != NULL) {
+    free(__stdin_reader._start);
+    __stdin_reader = saved_reader;
+  }
+  __restore_fd(saved_in, STDIN_FILENO);
+  __restore_fd(saved_out, STDOUT_FILENO);
+  return code;
+}
+
+// launch a pipeline as a new job; the job is valid until the next one
+// is added
+static struct __job*
+__start_job(struct __parse_result* command)
+{
+  struct __job* job = __add_job(command);
+  int n;
+  // output the shell buffered must not be repeated by forked children
+  fflush(stdout);
+  __launch(
+    command, __job_builtins, job->pids, __job_control() ? &job->pgid : NULL);
+  for (n = 0; n < job->n_procs; n++) {
+    if (job->pids[n] > 0) {
+      __pid_table_insert(job->pids[n], job->id);
+      job->states[n] = __STAGE_RUNNING;
+      job->n_live++;
+    }
+  }
+  __job_check_done(job);
+  return job;
+}
+
+/**
+ * Run a command line as a job: in the foreground, returning its exit
+ * code once it is done or stopped, or in the background, where it is
+ * reaped as it exits. A lone builtin in the foreground runs in the shell
+ * itself.
+ */
+int
+__run_job(struct __parse_result* command)
+{
+  struct __command* first = __VEC_FIRST(command->commands);
+  const struct __builtin* builtin;
+  struct __job* job;
+
+  if (__VEC_LEN(command->commands) == 1 && !command->background &&
+      (builtin = __find_builtin(__job_builtins, *first->args)) != NULL) {
+    return __run_builtin(first, builtin);
+  }
+
+  job = __start_job(command);
+
+  if (command->background) {
+    if (__interactive) {
+      fprintf(stderr, "[%d] %d\n", job->id, (int)job->pgid);
+    }
+    return EXIT_SUCCESS;
+  }
+  return __foreground(job, 0);
+}
+
+// the job named by spec (%n, %+, %%, %- or a pid), or by default the
+// current job; reports and returns NULL if there is none. With live,
+// a job that is done counts as none; with stopped, the default is the
+// latest stopped job.
+static struct __job*
+__find_job(const char* cmd, const char* spec, char live, char stopped)
+{
+  struct __job* job = NULL;
+  if (spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+    for (job = __jobs._end - 1; job >= __jobs._start; job--) {
+      if (job->n_live > 0 && (!stopped || __job_stopped(job))) {
+        break;
+      }
+    }
+    if (job < __jobs._start) {
+      job = NULL;
+    }
+  } else if (strcmp(spec, "%-") == 0) {
+    job = __jobs._end - __jobs._start >= 2 ? __jobs._end - 2 : NULL;
+  } else if (*spec == '%') {
+    job = __job_by_id(atoi(spec + 1));
+  } else {
+    job = __job_by_id(__pid_table_find(atoi(spec)));
+  }
+  if (job == NULL || (live && job->n_live == 0)) {
+    fprintf(stderr, "%s: %s: no such job\n", cmd, spec ? spec : "current");
+    return NULL;
+  }
+  return job;
+}
+
+// `jobs`: list every job
+int
+__jobs_builtin(char** args)
+{
+  struct __job* job;
+  (void)args;
+  __reap_jobs();
+  for (job = __jobs._start; job < __jobs._end; job++) {
+    __print_job(stdout, job);
+    if (job->n_live == 0) {
+      __job_reported(job);
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+// `fg [job]`: continue a job in the foreground and wait for it
+int
+__fg_builtin(char** args)
+{
+  struct __job* job = __find_job("fg", args[1], 1, 0);
+  if (job == NULL) {
+    return EXIT_FAILURE;
+  }
+  printf("%s\n", job->text);
+  fflush(stdout);
+  return __foreground(job, 1);
+}
+
+// `bg [job]`: continue a stopped job in the background
+int
+__bg_builtin(char** args)
+{
+  struct __job* job = __find_job("bg", args[1], 1, 1);
+  if (job == NULL) {
+    return EXIT_FAILURE;
+  }
+  job->background = 1;
+  __continue_job(job);
+  printf("[%d]  %s &\n", job->id, job->text);
+  return EXIT_SUCCESS;
+}
+
+// `wait [job...]`: wait for the given jobs, or every running job;
+// returns the exit code of the last one named
+int
+__wait_builtin(char** args)
+{
+  int code = EXIT_SUCCESS;
+  size_t n;
+  if (args[1] == NULL) {
+    // jobs are neither added nor removed while waiting
+    for (n = 0; n < (size_t)(__jobs._end - __jobs._start); n++) {
+      struct __job* job = __jobs._start + n;
+      __wait_job(job, NULL);
+      if (job->n_live == 0) {
+        __job_reported(job);
+      }
+    }
+    return code;
+  }
+  for (args++; *args != NULL; args++) {
+    struct __job* job = __find_job("wait", *args, 0, 0);
+    if (job == NULL) {
+      code = 127;
+      continue;
+    }
+    __wait_job(job, NULL);
+    if (job->n_live == 0) {
+      __job_reported(job);
+      code = __status_code(job->status);
+    } else {
+      code = 128 + SIGTSTP;
+    }
+  }
+  return code;
+}
+
+#endif
@@ -0,0 +1,326 @@
+#include "jobs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef _PARALLEL_H
+#define _PARALLEL_H 1
+
+// output is read from a job's pipe this much at a time
+#define __PARALLEL_READ_SIZE (1 << 16)
+
+struct __vec_parse_result
+{
+  struct __parse_result* _start;
+  struct __parse_result* _end;
+  struct __parse_result* _mem_end;
+};
+
+// a command of a batch while it runs
+struct __parallel_slot
+{
+  int index;        // its place in the batch, from 1; 0 for a free slot
+  int job;          // its job id
+  int fd;           // read end of its output pipe, -1 at end of file
+  struct __str out; // its output so far, kept for the next command
+  struct timespec start;
+};
+
+// set by ^C while a batch runs under job control
+static volatile sig_atomic_t __parallel_interrupted = 0;
+
+static void
+__on_parallel_sigint(int sig)
+{
+  int saved = errno;
+  (void)sig;
+  __parallel_interrupted = 1;
+  // wake the loop up
+  if (write(__sigchld_pipe[1], "", 1) < 0) {
+  }
+  errno = saved;
+}
+
+static void
+__write_all(int fd, const char* buf, size_t size)
+{
+  while (size > 0) {
+    ssize_t n = write(fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("write");
+      return;
+    }
+    buf += n;
+    size -= n;
+  }
+}
+
+static inline double
+__seconds_since(const struct timespec* start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// start a command of the batch with its stdout piped back to us; the
+// shell's stdout is out, to be put back once the job has it
+static void
+__parallel_start(struct __parse_result* command,
+                 struct __parallel_slot* slot,
+                 int index,
+                 int out)
+{
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  // the job's stages inherit stdout, as the first and last stages of a
+  // pipeline inherit the shell's
+  dup2(fds[1], STDOUT_FILENO);
+  close(fds[1]);
+  command->background = 0;
+  slot->job = __start_job(command)->id;
+  dup2(out, STDOUT_FILENO);
+
+  slot->index = index;
+  slot->fd = fds[0];
+  clock_gettime(CLOCK_MONOTONIC, &slot->start);
+}
+
+// read what a command has written; returns 0 at end of file
+static int
+__parallel_read(struct __parallel_slot* slot)
+{
+  ssize_t n;
+  __VEC_RESERVE(slot->out, __PARALLEL_READ_SIZE);
+  do {
+    n = read(slot->fd, slot->out._end, slot->out._mem_end - slot->out._end);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    perror("read");
+  }
+  if (n <= 0) {
+    close(slot->fd);
+    slot->fd = -1;
+    return 0;
+  }
+  slot->out._end += n;
+  return 1;
+}
+
+// write out a finished command's output in one piece and report how it
+// went; returns its exit code
+static int
+__parallel_finish(struct __parallel_slot* slot, int out)
+{
+  struct __job* job = __job_by_id(slot->job);
+  double wall = __seconds_since(&slot->start);
+  int code = __status_code(job->status);
+
+  __write_all(out, slot->out._start, slot->out._end - slot->out._start);
+  fprintf(stderr,
+          "parallel: [%d] exit %d, %.3fs: %s\n",
+          slot->index,
+          code,
+          wall,
+          job->text);
+  __job_reported(job);
+
+  slot->out._end = slot->out._start;
+  slot->index = 0;
+  return code;
+}
+
+/**
+ * `parallel [-j N]`: run the command lines read from stdin, at most N at
+ * a time (by default one per CPU). Each is a pipeline like any other
+ * command line, run with stdin from /dev/null. Its stdout is buffered
+ * until it is done and then written in one piece, so the outputs of
+ * commands never interleave; stderr is not buffered. The exit code and
+ * wall time of each command, and of the whole batch, go to stderr.
+ */
+int
+__parallel_builtin(char** args)
+{
+  long limit = sysconf(_SC_NPROCESSORS_ONLN);
+  struct __arena arena = __ARENA_INIT;
+  struct __vec_parse_result batch = __NULL_VEC;
+  struct __parallel_slot* slots;
+  struct pollfd* fds;
+  struct __parallel_slot** polled;
+  struct sigaction action, saved_action;
+  struct timespec start;
+  int null_fd, saved_in, saved_out;
+  int total, next = 0, running = 0, failed = 0, line = 0;
+  char job_control = __job_control(), forwarded = 0;
+  int s;
+
+  // options
+  for (args++; *args != NULL; args++) {
+    const char* value = NULL;
+    if (strcmp(*args, "-j") == 0) {
+      value = *(++args);
+    } else if (strncmp(*args, "-j", 2) == 0) {
+      value = *args + 2;
+    }
+    if (value == NULL || (limit = atol(value)) <= 0) {
+      fprintf(stderr, "usage: parallel [-j N] < commands\n");
+      return EXIT_FAILURE;
+    }
+  }
+  if (limit <= 0) {
+    limit = 1;
+  }
+
+  // the batch, one command line after another
+  do {
+    struct __parse_result parsed = __parse_line(&__stdin_reader, &arena, 0);
+    line++;
+    if (parsed._err != NULL) {
+      fprintf(stderr, "parallel: line %d: %s\n", line, parsed._err);
+      failed++;
+    } else if (!__VEC_EMPTY(parsed.commands)) {
+      __VEC_RESERVE(batch, 1);
+      *(batch._end++) = parsed;
+    }
+  } while (!__stdin_reader._eof);
+  total = __VEC_LEN(batch);
+  if (limit > total) {
+    limit = total > 0 ? total : 1;
+  }
+
+  __CHECKED_MALLOC(slots, limit);
+  __CHECKED_MALLOC(fds, limit + 1);
+  __CHECKED_MALLOC(polled, limit + 1);
+  for (s = 0; s < limit; s++) {
+    struct __str empty = __NULL_VEC;
+    slots[s].index = 0;
+    slots[s].out = empty;
+  }
+
+  // commands must not read the batch, or the terminal from the
+  // background
+  fflush(stdout);
+  if ((null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC)) < 0) {
+    perror("open /dev/null");
+    exit(EXIT_FAILURE);
+  }
+  saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+  saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+  dup2(null_fd, STDIN_FILENO);
+  close(null_fd);
+
+  // a forked parallel needs its own wakeups; under job control every
+  // command has its own process group, so ^C is passed on to them
+  __init_sigchld();
+  __parallel_interrupted = 0;
+  if (job_control) {
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = __on_parallel_sigint;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &saved_action);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (;;) {
+    int n_fds = 0;
+    int n;
+
+    // fill the free slots
+    for (s = 0; s < limit && next < total && !__parallel_interrupted; s++) {
+      if (slots[s].index == 0) {
+        __parallel_start(batch._start + next, &slots[s], next + 1, saved_out);
+        next++;
+        running++;
+      }
+    }
+    if (running == 0) {
+      break;
+    }
+    if (__parallel_interrupted && !forwarded) {
+      for (s = 0; s < limit; s++) {
+        struct __job* job;
+        if (slots[s].index != 0 && (job = __job_by_id(slots[s].job))->pgid > 0) {
+          kill(-job->pgid, SIGINT);
+        }
+      }
+      forwarded = 1;
+    }
+
+    // wait for output or exits
+    fds[n_fds].fd = __sigchld_pipe[0];
+    fds[n_fds].events = POLLIN;
+    polled[n_fds++] = NULL;
+    for (s = 0; s < limit; s++) {
+      if (slots[s].index != 0 && slots[s].fd >= 0) {
+        fds[n_fds].fd = slots[s].fd;
+        fds[n_fds].events = POLLIN;
+        polled[n_fds++] = &slots[s];
+      }
+    }
+    if (poll(fds, n_fds, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      exit(EXIT_FAILURE);
+    }
+    if (fds[0].revents & POLLIN) {
+      char drain[256];
+      while (read(__sigchld_pipe[0], drain, sizeof(drain)) > 0) {
+      }
+      __reap_jobs();
+    }
+    for (n = 1; n < n_fds; n++) {
+      if (fds[n].revents != 0) {
+        __parallel_read(polled[n]);
+      }
+    }
+
+    // a command is done once every stage has exited and its output is
+    // all read
+    for (s = 0; s < limit; s++) {
+      if (slots[s].index != 0 && slots[s].fd < 0 &&
+          __job_by_id(slots[s].job)->n_live == 0) {
+        failed += __parallel_finish(&slots[s], saved_out) != 0;
+        running--;
+      }
+    }
+  }
+
+  if (job_control) {
+    sigaction(SIGINT, &saved_action, NULL);
+  }
+  __restore_fd(saved_in, STDIN_FILENO);
+  __restore_fd(saved_out, STDOUT_FILENO);
+  fprintf(stderr,
+          "parallel: %d of %d commands run, %d failed, %.3fs\n",
+          next,
+          total,
+          failed,
+          __seconds_since(&start));
+
+  for (s = 0; s < limit; s++) {
+    free(slots[s].out._start);
+  }
+  free(slots);
+  free(fds);
+  free(polled);
+  free(batch._start);
+  __arena_free(&arena);
+  return failed > 0 || next < total ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "utility.h"
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/wait.h>
@@ -89,6 +91,8 @@ struct __vec_command
   struct __command* _mem_end;
 };
 
+// a parse result and everything in it lives in the arena it was parsed
+// into, and is freed all at once by resetting that arena
 struct __parse_result
 {
   char* _err; // NULL if ok, check first
@@ -97,99 +101,151 @@ struct __parse_result
 };
 
 void
-__free_vec_str(struct __vec_str* vec_str)
-{
-  if (vec_str->_start != NULL) {
-    char** p;
-    char* s;
-    for (p = vec_str->_start; p < vec_str->_end; p++) {
-      s = *p;
-      if (s != NULL) {
-        free(s);
-      }
-    }
-    free(vec_str->_start);
-  }
-}
+__debug_print_syn(const struct __vec_syn* vec_syn);
 
 void
-__free_vec_syn(struct __vec_syn* vec_syn)
+__debug_print_parsed(const struct __parse_result* parsed);
+
+// stdin is read in blocks of this size
+#define __READ_BLOCK_SIZE (1 << 16)
+
+// a word with byte _b in every byte
+#define __SWAR_REPEAT(_b) (0x0101010101010101ULL * (unsigned char)(_b))
+
+// high bit of each byte of _w set iff that byte is zero
+#define __SWAR_ZERO(_w)                                                        \
+  (~((((_w)&__SWAR_REPEAT(0x7f)) + __SWAR_REPEAT(0x7f)) | (_w) |               \
+     __SWAR_REPEAT(0x7f)))
+
+struct __block_reader
 {
-  assert(vec_syn->_start != NULL);
-  struct __syn* s;
-  for (s = vec_syn->_start; s < vec_syn->_end; s++) {
-    __free_vec_str(&s->data);
+  int _fd;
+  char* _start; // the block buffer
+  char* _pos;   // next byte to tokenize
+  char* _end;   // end of the bytes read
+  char _eof;    // the last line ended at end of file
+};
+
+#define __READER_INIT(_fd)                                                     \
+  {                                                                            \
+    _fd, NULL, NULL, NULL, 0,                                                  \
   }
-  free(vec_syn->_start);
-}
 
-void
-__free_cmd(struct __command* cmd)
+static struct __block_reader __stdin_reader = __READER_INIT(STDIN_FILENO);
+
+// read the next block, return 0 at end of file
+static int
+__reader_fill(struct __block_reader* reader)
 {
-  if (cmd->_in_file != NULL) {
-    free(cmd->_in_file);
+  ssize_t n;
+  if (reader->_start == NULL) {
+    __CHECKED_MALLOC(reader->_start, __READ_BLOCK_SIZE);
   }
-  if (cmd->_out_file != NULL) {
-    free(cmd->_out_file);
-  }
-  char** args = cmd->args;
-  if (args != NULL) {
-    char** s;
-    for (s = args; *s != NULL; s++) {
-      free(*s);
-    }
-    free(args);
+  do {
+    n = read(reader->_fd, reader->_start, __READ_BLOCK_SIZE);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    perror("read");
+    exit(EXIT_FAILURE);
   }
+  reader->_pos = reader->_start;
+  reader->_end = reader->_start + n;
+  return n > 0;
 }
 
-void
-__free_commands(struct __vec_command* commands)
+// delimiter bytes (' ', '|', '<', '>', '&', '\\', '\n', '\r') in word _w.
+// '<' and '>' differ only in bit 1, '\\' and '|' only in bit 5, so
+// both pairs are found with one comparison each.
+static inline uint64_t
+__delimiters(uint64_t w)
 {
-  if (commands->_start == NULL) {
-    return;
-  }
-  struct __command* cmd;
-  for (cmd = commands->_start; cmd < commands->_end; cmd++) {
-    __free_cmd(cmd);
-  }
-  free(commands->_start);
+  return __SWAR_ZERO(w ^ __SWAR_REPEAT(__SPACE)) |
+         __SWAR_ZERO(w ^ __SWAR_REPEAT(__AMPERSAND)) |
+         __SWAR_ZERO((w | __SWAR_REPEAT(0x02)) ^ __SWAR_REPEAT(__TO_FILE)) |
+         __SWAR_ZERO((w | __SWAR_REPEAT(0x20)) ^ __SWAR_REPEAT(__PIPE)) |
+         __SWAR_ZERO(w ^ __SWAR_REPEAT(__NEWLINE)) |
+         __SWAR_ZERO(w ^ __SWAR_REPEAT(__RETURN));
 }
 
-void
-__free_parsed_result(struct __parse_result* parsed)
+// first delimiter in [p, end), or end; scans a word at a time
+static inline const char*
+__scan_delimiter(const char* p, const char* end)
 {
-  // the err string is static and should not be freed
-  __free_commands(&parsed->commands);
+  while (end - p >= 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    uint64_t found = __delimiters(w);
+    if (found != 0) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      return p + (__builtin_ctzll(found) >> 3);
+#else
+      return p + (__builtin_clzll(found) >> 3);
+#endif
+    }
+    p += 8;
+  }
+  for (; p < end; p++) {
+    uint64_t w = (unsigned char)*p;
+    if (__delimiters(w) & 0x80) {
+      return p;
+    }
+  }
+  return end;
 }
 
-void
-__debug_print_syn(const struct __vec_syn* vec_syn);
-
-void
-__debug_print_parsed(const struct __parse_result* parsed);
+// finish the token in str (if any) as an arg
+#define __END_TOKEN(_arena, _str, _args)                                       \
+  if (!__VEC_EMPTY(_str)) {                                                    \
+    char _nul = __END;                                                         \
+    __ARENA_VEC_APPEND(_arena, _str, &_nul, 1);                                \
+    __ARENA_VEC_INSERT(_arena, _args, _str._start);                            \
+    struct __str _empty = __NULL_VEC;                                          \
+    _str = _empty;                                                             \
+  }
 
+// tokenize a line from reader; end of file ends the line too, and sets
+// reader->_eof
 struct __vec_syn
-__tokenize_stdin(char debug)
+__tokenize(struct __block_reader* reader, struct __arena* arena, char debug)
 {
-  // init containers
+  // init containers in the arena; str is allocated once a token starts
   struct __vec_syn syn;
   struct __vec_str args;
-  struct __str str;
-  __VEC_INIT(syn, __ARGS_INIT_SIZE);
-  __VEC_INIT(args, __ARGS_INIT_SIZE);
-  __VEC_INIT(str, __STR_INIT_SIZE);
+  struct __str str = __NULL_VEC;
+  __ARENA_VEC_INIT(arena, syn, __ARGS_INIT_SIZE);
+  __ARENA_VEC_INIT(arena, args, __ARGS_INIT_SIZE);
 
   // parser states
   char escape = 0;
+  char c;
 
   // start to parse
+  reader->_eof = 0;
   for (;;) {
-    int c = getchar();
+    if (reader->_pos == reader->_end && !__reader_fill(reader)) {
+      reader->_eof = 1;
+      goto end_line;
+    }
 
-    if (c == EOF) {
-      exit(EXIT_SUCCESS);
+    // copy the run of plain chars up to the next delimiter in one go.
+    // an escape lasts until a char it applies to, so go one char at a
+    // time while one is pending.
+    if (!escape) {
+      const char* run = reader->_pos;
+      const char* stop = __scan_delimiter(run, reader->_end);
+      if (stop > run) {
+        // with room for the NUL, so the token is not copied again
+        __ARENA_VEC_RESERVE(arena, str, (stop - run) + 1);
+        __ARENA_VEC_APPEND(arena, str, run, stop - run);
+        reader->_pos = (char*)stop;
+      }
+      if (stop == reader->_end) {
+        continue;
+      }
     }
 
+    c = *(reader->_pos++);
+
     // char insertion
     switch (c) {
       case __NEWLINE:
@@ -197,41 +253,13 @@ __tokenize_stdin(char debug)
         break;
 
       case __SPACE:
-        if (escape) {
-          escape = 0;
-          __VEC_INSERT(str, __SPACE);
-          continue;
-        }
-        break;
-
       case __PIPE:
-        if (escape) {
-          escape = 0;
-          __VEC_INSERT(str, __PIPE);
-          continue;
-        }
-        break;
-
       case __FROM_FILE:
-        if (escape) {
-          escape = 0;
-          __VEC_INSERT(str, __FROM_FILE);
-          continue;
-        }
-        break;
-
       case __AMPERSAND:
-        if (escape) {
-          escape = 0;
-          __VEC_INSERT(str, __AMPERSAND);
-          continue;
-        }
-        break;
-
       case __TO_FILE:
         if (escape) {
           escape = 0;
-          __VEC_INSERT(str, __TO_FILE);
+          __ARENA_VEC_APPEND(arena, str, &c, 1);
           continue;
         }
         break;
@@ -239,7 +267,7 @@ __tokenize_stdin(char debug)
       case __ESC:
         if (escape) {
           escape = 0;
-          __VEC_INSERT(str, __ESC);
+          __ARENA_VEC_APPEND(arena, str, &c, 1);
         } else {
           escape = 1;
         }
@@ -248,23 +276,21 @@ __tokenize_stdin(char debug)
       case __ESC_NEWLINE:
         if (escape) {
           escape = 0;
-          __VEC_INSERT(str, __NEWLINE);
-        } else {
-          __VEC_INSERT(str, c);
+          c = __NEWLINE;
         }
+        __ARENA_VEC_APPEND(arena, str, &c, 1);
         continue;
 
       case __ESC_RETURN:
         if (escape) {
           escape = 0;
-          __VEC_INSERT(str, __RETURN);
-        } else {
-          __VEC_INSERT(str, c);
+          c = __RETURN;
         }
+        __ARENA_VEC_APPEND(arena, str, &c, 1);
         continue;
 
       default:
-        __VEC_INSERT(str, c);
+        __ARENA_VEC_APPEND(arena, str, &c, 1);
         continue;
     }
 
@@ -273,17 +299,11 @@ __tokenize_stdin(char debug)
       // should return
       case __NEWLINE:
       case __RETURN:
-        if (!__VEC_EMPTY(str)) {
-          __VEC_INSERT(str, __END);
-          __VEC_INSERT(args, str._start); // moved
-        } else {
-          free(str._start); // freed
-        }
+      end_line:
+        __END_TOKEN(arena, str, args);
         if (!__VEC_EMPTY(args)) {
-          __VEC_INSERT(args, __ARGS_END);
-          __VEC_INSERT(syn, __SYN_ARGS(args)); // moved
-        } else {
-          free(args._start); // freed
+          __ARENA_VEC_INSERT(arena, args, __ARGS_END);
+          __ARENA_VEC_INSERT(arena, syn, __SYN_ARGS(args));
         }
         if (debug) {
           __debug_print_syn(&syn);
@@ -293,39 +313,31 @@ __tokenize_stdin(char debug)
       // should continue
       case __SPACE:
         // str -> args syn for ' '
-        if (!__VEC_EMPTY(str)) {
-          __VEC_INSERT(str, __END);
-          __VEC_INSERT(args, str._start);   // moved
-          __VEC_INIT(str, __STR_INIT_SIZE); // init
-        }
+        __END_TOKEN(arena, str, args);
         break;
       case __PIPE:
       case __FROM_FILE:
       case __TO_FILE:
       case __AMPERSAND:
         // str -> args -> syn for '|','>','<','&'
-        if (!__VEC_EMPTY(str)) {
-          __VEC_INSERT(str, __END);
-          __VEC_INSERT(args, str._start);   // moved
-          __VEC_INIT(str, __STR_INIT_SIZE); // init
-        }
+        __END_TOKEN(arena, str, args);
         if (!__VEC_EMPTY(args)) {
-          __VEC_INSERT(args, __ARGS_END);
-          __VEC_INSERT(syn, __SYN_ARGS(args)); // moved
-          __VEC_INIT(args, __ARGS_INIT_SIZE);  // init
+          __ARENA_VEC_INSERT(arena, args, __ARGS_END);
+          __ARENA_VEC_INSERT(arena, syn, __SYN_ARGS(args));
+          __ARENA_VEC_INIT(arena, args, __ARGS_INIT_SIZE);
         }
         switch (c) {
           case __PIPE:
-            __VEC_INSERT(syn, __SYN_PIPE);
+            __ARENA_VEC_INSERT(arena, syn, __SYN_PIPE);
             break;
           case __FROM_FILE:
-            __VEC_INSERT(syn, __SYN_FROM_FILE);
+            __ARENA_VEC_INSERT(arena, syn, __SYN_FROM_FILE);
             break;
           case __TO_FILE:
-            __VEC_INSERT(syn, __SYN_TO_FILE);
+            __ARENA_VEC_INSERT(arena, syn, __SYN_TO_FILE);
             break;
           case __AMPERSAND:
-            __VEC_INSERT(syn, __SYN_AMPERSAND);
+            __ARENA_VEC_INSERT(arena, syn, __SYN_AMPERSAND);
             break;
           default:
             assert(0);
@@ -338,17 +350,18 @@ __tokenize_stdin(char debug)
   }
 }
 
+// parse a line from reader into the arena
 struct __parse_result
-__parse_cmd(char debug)
+__parse_line(struct __block_reader* reader, struct __arena* arena, char debug)
 {
-  // read from stdin
-  struct __vec_syn vec_syn = __tokenize_stdin(debug);
+  // read from reader
+  struct __vec_syn vec_syn = __tokenize(reader, arena, debug);
 
   // init structs
   struct __parse_result result = __P_RESULT_INIT;
   {
     struct __vec_command commands;
-    __VEC_INIT(commands, __ARGS_INIT_SIZE);
+    __ARENA_VEC_INIT(arena, commands, __ARGS_INIT_SIZE);
     result.commands = commands;
   }
   struct __command this_command = __CMD_INIT;
@@ -376,7 +389,7 @@ __parse_cmd(char debug)
             assert(0);
           case __syn_args: {
             assert(this_command.args != NULL);
-            __VEC_INSERT(result.commands, this_command); // moved
+            __ARENA_VEC_INSERT(arena, result.commands, this_command);
             // clear this_command
             this_command.args = NULL;
             this_command._in_file = NULL;
@@ -447,7 +460,6 @@ __parse_cmd(char debug)
           case __syn_pipe:
             assert(this_command.args == NULL);
             this_command.args = syn->data._start;
-            syn->data._start = NULL; // move args (char**)
             break;
           case __syn_from_file: {
             size_t arg_len = __VEC_LEN(syn->data);
@@ -459,7 +471,6 @@ __parse_cmd(char debug)
             }
             assert(*syn->data._start != NULL);
             this_command._in_file = *syn->data._start;
-            *syn->data._start = NULL; // move first args (char*)
             break;
           }
           case __syn_to_file: {
@@ -472,7 +483,6 @@ __parse_cmd(char debug)
             }
             assert(*syn->data._start != NULL);
             this_command._out_file = *syn->data._start;
-            *syn->data._start = NULL; // move first args (char*)
             break;
           }
           case __syn_ampersand:
@@ -499,7 +509,7 @@ __parse_cmd(char debug)
 
   // deal with the last command
   if (this_command.args != NULL) {
-    __VEC_INSERT(result.commands, this_command); // moved
+    __ARENA_VEC_INSERT(arena, result.commands, this_command);
     // clear this_command
     this_command.args = NULL;
     this_command._in_file = NULL;
@@ -511,20 +521,25 @@ __parse_cmd(char debug)
 
 cleanup:
   if (result._err != NULL) {
-    // cleanup
-    __free_commands(&result.commands);
     result.commands._start = NULL;
   }
-  // free syn
-  __free_vec_syn(&vec_syn);
-  // free cmd
-  __free_cmd(&this_command);
   if (debug) {
     __debug_print_parsed(&result);
   }
   return result;
 }
 
+// parse a line from stdin into the arena; exits at end of input
+struct __parse_result
+__parse_cmd(struct __arena* arena, char debug)
+{
+  struct __parse_result result = __parse_line(&__stdin_reader, arena, debug);
+  if (__stdin_reader._eof) {
+    exit(EXIT_SUCCESS);
+  }
+  return result;
+}
+
 void
 __print_args(const struct __vec_str args, char sep)
 {
@@ -604,7 +619,7 @@ __debug_print_parsed(const struct __parse_result* parsed)
 }
 
 void
-__print_arg_s(const char* arg)
+__fprint_arg_s(FILE* out, const char* arg)
 {
   char c;
   for(;;) {
@@ -613,10 +628,10 @@ __print_arg_s(const char* arg)
       case __END:
         return;
       case __NEWLINE:
-        printf("\\n");
+        fprintf(out, "\\n");
         break;
       case __RETURN:
-        printf("\\r");
+        fprintf(out, "\\r");
         break;
       case __SPACE:
       case __PIPE:
@@ -624,27 +639,27 @@ __print_arg_s(const char* arg)
       case __AMPERSAND:
       case __TO_FILE:
       case __ESC:
-        printf("\\%c", c);
+        fprintf(out, "\\%c", c);
         break;
       default:
-        printf("%c", c);
+        fputc(c, out);
         break;
     }
   };
 }
 
 void
-__print_parsed(const struct __parse_result* parsed)
+__fprint_parsed(FILE* out, const struct __parse_result* parsed)
 {
   if (parsed->_err != NULL) {
-    printf("error: %s\n", parsed->_err);
+    fprintf(out, "error: %s\n", parsed->_err);
     return;
   }
   char should_add_pipe = 0;
   struct __command* cmd;
   for (cmd = parsed->commands._start; cmd < parsed->commands._end; cmd++) {
     if (should_add_pipe) {
-      printf(" | ");
+      fprintf(out, " | ");
     } else {
       should_add_pipe = 1;
     }
@@ -657,26 +672,32 @@ __print_parsed(const struct __parse_result* parsed)
         if (arg_s == NULL)
           break;
         if (should_add_space) {
-          printf(" ");
+          fprintf(out, " ");
         } else {
           should_add_space = 1;
         }
-        __print_arg_s(arg_s);
+        __fprint_arg_s(out, arg_s);
       };
     }
     if (cmd->_in_file != NULL) {
-      printf(" < ");
-      __print_arg_s(cmd->_in_file);
+      fprintf(out, " < ");
+      __fprint_arg_s(out, cmd->_in_file);
     }
     if (cmd->_out_file != NULL) {
-      printf(" > ");
-      __print_arg_s(cmd->_out_file);
+      fprintf(out, " > ");
+      __fprint_arg_s(out, cmd->_out_file);
     }
   }
   if (parsed->background) {
-    printf(" &");
+    fprintf(out, " &");
   }
-  printf("\n");
+  fprintf(out, "\n");
+}
+
+void
+__print_parsed(const struct __parse_result* parsed)
+{
+  __fprint_parsed(stdout, parsed);
 }
 
 #endif
@@ -0,0 +1,77 @@
+/**
+ * Pipeline launch latency: spawn versus fork.
+ *
+ * Times how long osh's __exec takes to start and reap pipelines of
+ * 1 to 64 stages of `true`, launching each stage with posix_spawn and
+ * then with fork + exec. The shell first touches rss MB of memory, since
+ * fork's cost grows with the page tables it has to copy.
+ *
+ * usage: ./spawn-bench [rss MB] [runs]
+ *
+ * gcc -O2 -o spawn-bench spawn-bench.c
+ */
+
+#include "exec.h"
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_RSS_MB 256
+#define DEFAULT_RUNS 200
+#define MAX_STAGES 64
+
+static double
+__now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char* argv[])
+{
+  long rss_mb = argc > 1 ? atol(argv[1]) : DEFAULT_RSS_MB;
+  int runs = argc > 2 ? atoi(argv[2]) : DEFAULT_RUNS;
+  static char* args[] = { "true", NULL };
+  struct __command stages[MAX_STAGES];
+  struct __parse_result pipeline = __P_RESULT_INIT;
+  int n, stages_n, run;
+
+  // a shell with a large resident set
+  char* rss = (char*)malloc(rss_mb << 20);
+  if (rss == NULL && rss_mb > 0) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+  memset(rss, 1, rss_mb << 20);
+
+  for (n = 0; n < MAX_STAGES; n++) {
+    stages[n]._in_file = NULL;
+    stages[n]._out_file = NULL;
+    stages[n].args = args;
+  }
+
+  printf("rss %ld MB, %d runs each\n", rss_mb, runs);
+  printf("%-8s %-14s %-14s %s\n", "stages", "spawn (us)", "fork (us)", "speedup");
+  for (stages_n = 1; stages_n <= MAX_STAGES; stages_n *= 2) {
+    double us[2];
+    pipeline.commands._start = stages;
+    pipeline.commands._end = stages + stages_n;
+    pipeline.commands._mem_end = stages + MAX_STAGES;
+
+    for (n = 0; n < 2; n++) {
+      double start;
+      __use_spawn = n == 0;
+      start = __now();
+      for (run = 0; run < runs; run++) {
+        __exec(&pipeline, NULL);
+      }
+      us[n] = (__now() - start) / runs * 1e6;
+    }
+    printf("%-8d %-14.1f %-14.1f %.2fx\n", stages_n, us[0], us[1], us[1] / us[0]);
+    fflush(stdout);
+  }
+
+  free(rss);
+  return 0;
+}
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #ifndef _UTILITY_H
 #define _UTILITY_H 1
@@ -55,6 +56,181 @@ struct __str
     *(_vec._end++) = _ele;                                                     \
   }
 
+// make room for _n more elements in vector _vec, which may still be
+// {NULL, NULL, NULL}; grows to exactly what is needed the first time.
+#define __VEC_RESERVE(_vec, _n)                                                \
+  if ((size_t)(_vec._mem_end - _vec._end) < (size_t)(_n)) {                    \
+    size_t _offset = _vec._end - _vec._start;                                  \
+    size_t _size = (_vec._mem_end - _vec._start) << 1;                         \
+    if (_size < _offset + (_n)) {                                              \
+      _size = _offset + (_n);                                                  \
+    }                                                                          \
+    __CHECKED_REALLOC(_vec._start, _size);                                     \
+    _vec._end = _vec._start + _offset;                                         \
+    _vec._mem_end = _vec._start + _size;                                       \
+  }
+
+// push back the _n elements at _src into vector _vec.
+#define __VEC_APPEND(_vec, _src, _n)                                           \
+  __VEC_RESERVE(_vec, _n);                                                     \
+  memcpy(_vec._end, _src, sizeof(*_vec._start) * (_n));                       \
+  _vec._end += (_n)
+
+// arena chunks hold at least this many bytes
+#define __ARENA_CHUNK_SIZE (1 << 16)
+
+// arena allocations are aligned to this
+#define __ARENA_ALIGN 16
+
+struct __arena_chunk
+{
+  struct __arena_chunk* _next;
+  size_t _size; // bytes of data after the header
+  char* _data;
+};
+
+// a bump allocator: memory is only given back all at once, by
+// __arena_reset, which keeps the chunks for reuse
+struct __arena
+{
+  struct __arena_chunk* _first;
+  struct __arena_chunk* _chunk; // chunk being filled
+  char* _pos;
+  char* _end;
+  char* _last; // the latest allocation, which can grow in place
+};
+
+#define __ARENA_INIT                                                           \
+  {                                                                            \
+    NULL, NULL, NULL, NULL, NULL,                                              \
+  }
+
+static inline void
+__arena_use_chunk(struct __arena* arena, struct __arena_chunk* chunk)
+{
+  arena->_chunk = chunk;
+  arena->_pos = chunk->_data;
+  arena->_end = chunk->_data + chunk->_size;
+}
+
+// allocate _size bytes from the arena (exit on error)
+static inline void*
+__arena_alloc(struct __arena* arena, size_t size)
+{
+  size = (size + __ARENA_ALIGN - 1) & ~(size_t)(__ARENA_ALIGN - 1);
+  if ((size_t)(arena->_end - arena->_pos) < size) {
+    struct __arena_chunk* next =
+      arena->_chunk != NULL ? arena->_chunk->_next : arena->_first;
+    if (next == NULL || next->_size < size) {
+      // a new chunk, after the current one
+      size_t data_size = size > __ARENA_CHUNK_SIZE ? size : __ARENA_CHUNK_SIZE;
+      struct __arena_chunk* chunk =
+        (struct __arena_chunk*)malloc(sizeof(*chunk) + data_size + __ARENA_ALIGN);
+      if (chunk == NULL) {
+        exit(EXIT_FAILURE);
+      }
+      chunk->_size = data_size;
+      chunk->_data = (char*)(((size_t)(chunk + 1) + __ARENA_ALIGN - 1) &
+                             ~(size_t)(__ARENA_ALIGN - 1));
+      chunk->_next = next;
+      if (arena->_chunk != NULL) {
+        arena->_chunk->_next = chunk;
+      } else {
+        arena->_first = chunk;
+      }
+      next = chunk;
+    }
+    __arena_use_chunk(arena, next);
+  }
+  arena->_last = arena->_pos;
+  arena->_pos += size;
+  return arena->_last;
+}
+
+// grow an allocation from _old_size to _new_size bytes; in place if it
+// is the latest one and its chunk has room, else by copying
+static inline void*
+__arena_realloc(struct __arena* arena,
+                void* ptr,
+                size_t old_size,
+                size_t new_size)
+{
+  if (ptr != NULL && ptr == arena->_last &&
+      (size_t)(arena->_end - arena->_last) >= new_size) {
+    size_t size = (new_size + __ARENA_ALIGN - 1) & ~(size_t)(__ARENA_ALIGN - 1);
+    arena->_pos = arena->_last + size;
+    return ptr;
+  }
+  void* grown = __arena_alloc(arena, new_size);
+  if (ptr != NULL) {
+    memcpy(grown, ptr, old_size);
+  }
+  return grown;
+}
+
+// free everything allocated from the arena in O(1), keeping its chunks
+static inline void
+__arena_reset(struct __arena* arena)
+{
+  if (arena->_first != NULL) {
+    __arena_use_chunk(arena, arena->_first);
+  }
+  arena->_last = NULL;
+}
+
+// give the arena's chunks back to the system
+static inline void
+__arena_free(struct __arena* arena)
+{
+  struct __arena_chunk* chunk = arena->_first;
+  while (chunk != NULL) {
+    struct __arena_chunk* next = chunk->_next;
+    free(chunk);
+    chunk = next;
+  }
+  struct __arena empty = __ARENA_INIT;
+  *arena = empty;
+}
+
+// initialize vector _vec in _arena with initial capacity _init_size.
+#define __ARENA_VEC_INIT(_arena, _vec, _init_size)                             \
+  _vec._start = (typeof(_vec._start))__arena_alloc(                            \
+    _arena, sizeof(*_vec._start) * (_init_size));                              \
+  _vec._end = _vec._start;                                                     \
+  _vec._mem_end = _vec._start + (_init_size)
+
+// make room for _n more elements in vector _vec, kept in _arena.
+#define __ARENA_VEC_RESERVE(_arena, _vec, _n)                                  \
+  if ((size_t)(_vec._mem_end - _vec._end) < (size_t)(_n)) {                    \
+    size_t _offset = _vec._end - _vec._start;                                  \
+    size_t _old = _vec._mem_end - _vec._start;                                 \
+    size_t _size = _old << 1;                                                  \
+    if (_size < _offset + (_n)) {                                              \
+      _size = _offset + (_n);                                                  \
+    }                                                                          \
+    _vec._start = (typeof(_vec._start))__arena_realloc(                        \
+      _arena,                                                                  \
+      _vec._start,                                                             \
+      sizeof(*_vec._start) * _old,                                             \
+      sizeof(*_vec._start) * _size);                                           \
+    _vec._end = _vec._start + _offset;                                         \
+    _vec._mem_end = _vec._start + _size;                                       \
+  }
+
+// push back _element into vector _vec, kept in _arena.
+#define __ARENA_VEC_INSERT(_arena, _vec, _element)                             \
+  __ARENA_VEC_RESERVE(_arena, _vec, 1);                                        \
+  {                                                                            \
+    typeof(*_vec._start) _ele = _element;                                      \
+    *(_vec._end++) = _ele;                                                     \
+  }
+
+// push back the _n elements at _src into vector _vec, kept in _arena.
+#define __ARENA_VEC_APPEND(_arena, _vec, _src, _n)                             \
+  __ARENA_VEC_RESERVE(_arena, _vec, _n);                                       \
+  memcpy(_vec._end, _src, sizeof(*_vec._start) * (_n));                       \
+  _vec._end += (_n)
+
 // check if vector is empty
 #define __VEC_EMPTY(_vec) (((_vec)._start) == ((_vec)._end))
 
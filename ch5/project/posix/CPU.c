@@ -1,12 +1,421 @@
 /**
  * "Virtual" CPU that also maintains track of system time.
+ *
+ * The CPUs are a discrete-event simulation. Time only moves from one
+ * event to the next: a task arriving, or a task reaching the end of its
+ * time slice. Pending events sit in a heap keyed by time; only the next
+ * arrival is kept there, the rest wait in arrival order, so the heap
+ * never holds more than one event per CPU plus one. A schedule that is
+ * still being read (see more_tasks) is read further only once every
+ * task read so far has arrived, so its tasks must be in arrival order.
+ *
+ * Every CPU has its own run queue, kept by the scheduling algorithm. An
+ * arriving task goes to the least loaded CPU. A CPU whose queue runs dry
+ * steals the next task from the CPU with the longest queue, and every
+ * balance_interval time units queued tasks are pushed from the busiest
+ * CPUs to the idlest. A task that runs on a different CPU than last time
+ * pays migration_cost, and switching a CPU to a different task costs
+ * context_switch.
+ *
+ * Every task's first run and completion are recorded, and once all
+ * tasks are done the turnaround, waiting and response times are
+ * reported.
  */
 
+#include <stdlib.h>
 #include <stdio.h>
 
 #include "task.h"
+#include "cpu.h"
+#include "heap.h"
+#include "output.h"
+#include "intern.h"
+#include "schedulers.h"
 
-// run this task for the specified time slice
-void run(Task *task, int slice) {
-    printf("Running task = [%s] [%d] [%d] for %d units.\n",task->name, task->priority, task->burst, slice);
+int quantum = QUANTUM;
+int context_switch = CONTEXT_SWITCH;
+int cpus = 1;
+int migration_cost = MIGRATION_COST;
+int balance_interval = BALANCE_INTERVAL;
+struct metrics metrics;
+int (*more_tasks)(void);
+
+// what each CPU is doing
+struct cpu {
+    int running;        // the task on the CPU, or -1 if it is idle
+    int last;           // the task that ran on it last, or -1
+    int queued;         // tasks waiting in its run queue
+    long busy;          // time spent running tasks
+};
+
+static struct cpu cpu[MAX_CPUS];
+static struct scheduler *scheduler;
+
+// pending arrivals in the order they will happen, or NULL when that is
+// the order of the tids; the next of them to arrive; and how many tasks
+// the scheduler has been told there is room for
+static int *arrivals;
+static int next;
+static int room;
+
+// system time, and what the CPUs have done with it
+static long now;
+static long queued;
+static long switches;
+static long migrations;
+
+// the current system time
+long current_time(void) {
+    return now;
+}
+
+// order tids by arrival, then by tid
+static int by_arrival(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+
+    if (tasks.arrival[x] != tasks.arrival[y])
+        return tasks.arrival[x] < tasks.arrival[y] ? -1 : 1;
+
+    return x - y;
+}
+
+// event keys: at the same time, arrivals are handled before the end of
+// a slice, so a preempted task goes behind tasks that just arrived
+#define ARRIVAL(time) (2 * (long) (time))
+#define SLICE_END(time) (2 * (long) (time) + 1)
+
+// tasks on a CPU, running or waiting
+static int load(int c) {
+    return cpu[c].queued + (cpu[c].running >= 0);
+}
+
+// the CPU with the least load
+static int idlest(void) {
+    int c, best = 0;
+
+    for (c = 1; c < cpus && load(best) > 0; c++) {
+        if (load(c) < load(best))
+            best = c;
+    }
+
+    return best;
+}
+
+// the CPU with the most tasks waiting
+static int busiest(void) {
+    int c, best = 0;
+
+    for (c = 1; c < cpus; c++) {
+        if (cpu[c].queued > cpu[best].queued)
+            best = c;
+    }
+
+    return best;
+}
+
+// put a task on a CPU's run queue
+static void enqueue_on(int c, int tid) {
+    scheduler->enqueue(c, tid);
+    cpu[c].queued++;
+    queued++;
+}
+
+// take the next task from a CPU's run queue
+static int pick_from(int c, int *slice) {
+    int tid = scheduler->pick_next_task(c, slice);
+
+    if (tid >= 0) {
+        cpu[c].queued--;
+        queued--;
+    }
+
+    return tid;
+}
+
+// move the next waiting task from one CPU's run queue to another's
+static void move_task(int from, int to) {
+    int slice;
+    int tid = pick_from(from, &slice);
+
+    if (tid >= 0)
+        enqueue_on(to, tid);
+}
+
+// push waiting tasks from the busiest CPUs to the idlest
+static void balance(void) {
+    int moves;
+
+    for (moves = 0; moves < cpus; moves++) {
+        int from = busiest(), to = idlest();
+
+        if (cpu[from].queued == 0 || load(from) - load(to) < 2)
+            break;
+        move_task(from, to);
+    }
+}
+
+// take the next waiting task from the CPU with the longest queue
+// returns 1 if a task was stolen or 0 if no CPU had one waiting
+static int steal(int c) {
+    int victim = busiest();
+
+    if (cpu[victim].queued == 0)
+        return 0;
+    move_task(victim, c);
+
+    return 1;
+}
+
+// start the next task in an idle CPU's run queue
+static void dispatch(struct heap *events, int c) {
+    long start = now;
+    int tid, slice;
+
+    if ((tid = pick_from(c, &slice)) < 0)
+        return;
+
+    if (tid != cpu[c].last) {
+        start += context_switch;
+        switches++;
+        cpu[c].last = tid;
+    }
+    if (tasks.cpu[tid] >= 0 && tasks.cpu[tid] != c) {
+        start += migration_cost;
+        migrations++;
+    }
+    tasks.cpu[tid] = c;
+    if (tasks.start[tid] < 0)
+        tasks.start[tid] = start;
+    if (slice > tasks.remaining[tid] || slice <= 0)
+        slice = tasks.remaining[tid];
+
+    // run this task for the slice
+    if (output_slice != NULL)
+        output_slice(c, tid, start, slice);
+    tasks.remaining[tid] -= slice;
+    cpu[c].busy += slice;
+    cpu[c].running = tid;
+    heap_insert(events, tid, SLICE_END(start + slice));
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *) a, y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+// the average, 99th percentile and maximum of one metric, sorting it
+static void summarize(struct metric *metric, long *values, int n) {
+    double total = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        total += values[i];
+    qsort(values, n, sizeof(long), compare_long);
+
+    metric->average = total / n;
+    metric->p99 = values[(long) n * 99 / 100];
+    metric->max = values[n - 1];
+}
+
+static void print_metric(const char *name, struct metric *metric) {
+    printf("%-16s average %.2f, p99 %ld, max %ld\n", name, metric->average,
+           metric->p99, metric->max);
+}
+
+// measure turnaround, waiting and response times, printing them for
+// every task with text output and in aggregate with any output
+static void report(void) {
+    int count = tasks.count;
+    long *turnaround = malloc(sizeof(long) * count);
+    long *waiting = malloc(sizeof(long) * count);
+    long *response = malloc(sizeof(long) * count);
+    long busy = 0;
+    int i;
+
+    if (turnaround == NULL || waiting == NULL || response == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    // whole columns at a time, which the compiler can vectorize
+    for (i = 0; i < count; i++)
+        turnaround[i] = tasks.finish[i] - tasks.arrival[i];
+    for (i = 0; i < count; i++)
+        waiting[i] = turnaround[i] - tasks.burst[i];
+    for (i = 0; i < count; i++)
+        response[i] = tasks.start[i] - tasks.arrival[i];
+
+    if (output == OUTPUT_TEXT) {
+        printf("\n%-12s %10s %10s %10s %10s\n", "Task", "Arrival", "Turnaround",
+               "Waiting", "Response");
+        for (i = 0; i < count; i++)
+            printf("%-12s %10d %10ld %10ld %10ld\n", intern_name(tasks.name[i]),
+                   tasks.arrival[i], turnaround[i], waiting[i], response[i]);
+    }
+
+    summarize(&metrics.turnaround, turnaround, count);
+    summarize(&metrics.waiting, waiting, count);
+    summarize(&metrics.response, response, count);
+
+    for (i = 0; i < cpus; i++)
+        busy += cpu[i].busy;
+    metrics.tasks = count;
+    metrics.time = now;
+    metrics.busy = now ? (double) busy / ((double) now * cpus) : 0.0;
+    metrics.switches = switches;
+    metrics.migrations = migrations;
+
+    if (output != OUTPUT_NONE) {
+        if (output == OUTPUT_TEXT)
+            printf("\n");
+        print_metric("Turnaround time", &metrics.turnaround);
+        print_metric("Waiting time", &metrics.waiting);
+        print_metric("Response time", &metrics.response);
+        printf("%d tasks in %ld units on %d CPU%s, CPU busy %.1f%%, "
+               "%ld context switches, %ld migrations\n",
+               count, now, cpus, cpus > 1 ? "s" : "",
+               100.0 * metrics.busy, switches, migrations);
+    }
+
+    free(turnaround);
+    free(waiting);
+    free(response);
+}
+
+// tell the scheduler if the task table has grown
+static void grow(void) {
+    if (tasks.capacity > room && scheduler->grow != NULL)
+        scheduler->grow(tasks.capacity);
+    room = tasks.capacity;
+}
+
+// the next task to arrive, reading more of a streamed schedule once
+// every task read so far has arrived
+// returns its tid, or -1 if every task has arrived
+static int next_arrival(void) {
+    int tid;
+
+    while (next == tasks.count && more_tasks != NULL) {
+        if (!more_tasks())
+            more_tasks = NULL;
+        grow();
+    }
+    if (next == tasks.count)
+        return -1;
+
+    if (arrivals != NULL)
+        return arrivals[next++];
+
+    tid = next++;
+    if (tid > 0 && tasks.arrival[tid] < tasks.arrival[tid - 1]) {
+        fprintf(stderr, "%s arrives before the task ahead of it; "
+                "a streamed schedule must be in arrival order\n",
+                intern_name(tasks.name[tid]));
+        exit(1);
+    }
+
+    return tid;
+}
+
+// queue the next task to arrive, if any
+static void queue_arrival(struct heap *events) {
+    int tid = next_arrival();
+
+    if (tid >= 0)
+        heap_insert(events, tid, ARRIVAL(tasks.arrival[tid]));
+}
+
+// run every task under the given algorithm, then report on them
+void simulate(struct scheduler *algorithm) {
+    struct heap events;
+    long next_balance = balance_interval;
+    int c;
+
+    scheduler = algorithm;
+    next = room = 0;
+    arrivals = NULL;
+
+    // a streamed schedule starts with its first block
+    while (tasks.count == 0 && more_tasks != NULL) {
+        if (!more_tasks())
+            more_tasks = NULL;
+    }
+    if (tasks.count == 0)
+        return;
+    grow();
+
+    // a schedule loaded whole is simulated in arrival order even if it
+    // is not written in it; schedules usually are already
+    if (more_tasks == NULL) {
+        for (c = 1; c < tasks.count; c++) {
+            if (tasks.arrival[c] < tasks.arrival[c - 1])
+                break;
+        }
+        if (c < tasks.count) {
+            arrivals = malloc(sizeof(int) * tasks.count);
+            if (arrivals == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+            for (c = 0; c < tasks.count; c++)
+                arrivals[c] = c;
+            qsort(arrivals, tasks.count, sizeof(int), by_arrival);
+        }
+    }
+
+    for (c = 0; c < cpus; c++)
+        cpu[c].running = cpu[c].last = -1;
+
+    output_begin();
+    heap_init(&events);
+    queue_arrival(&events);
+
+    while (heap_peek(&events) >= 0) {
+        now = heap_peek_key(&events) / 2;
+
+        // handle every event at this time before choosing what runs next
+        while (heap_peek(&events) >= 0 && heap_peek_key(&events) / 2 == now) {
+            long key = heap_peek_key(&events);
+            int tid = heap_extract(&events);
+
+            if (key == ARRIVAL(now)) {
+                // a task's run state starts when it arrives
+                tasks.remaining[tid] = tasks.burst[tid];
+                tasks.start[tid] = -1;
+                tasks.cpu[tid] = -1;
+                tasks.next[tid] = -1;
+                enqueue_on(idlest(), tid);
+                queue_arrival(&events);
+            }
+            else {
+                cpu[tasks.cpu[tid]].running = -1;
+                if (tasks.remaining[tid] == 0)
+                    tasks.finish[tid] = now;
+                else
+                    enqueue_on(tasks.cpu[tid], tid);
+            }
+        }
+
+        if (cpus > 1 && balance_interval > 0 && now >= next_balance) {
+            balance();
+            next_balance = now - now % balance_interval + balance_interval;
+        }
+
+        // idle CPUs start their own tasks first, then steal
+        for (c = 0; c < cpus && queued > 0; c++) {
+            if (cpu[c].running < 0 && cpu[c].queued > 0)
+                dispatch(&events, c);
+        }
+        for (c = 0; c < cpus && queued > 0; c++) {
+            if (cpu[c].running < 0 && steal(c))
+                dispatch(&events, c);
+        }
+    }
+
+    heap_free(&events);
+    free(arrivals);
+    output_end();
+
+    report();
 }
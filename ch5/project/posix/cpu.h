@@ -1,5 +1,54 @@
-// length of a time quantum
+// default length of a time quantum
 #define QUANTUM 10
 
-// run the specified task for the following time slice
-void run(Task *task, int slice);
+// default time taken to switch a CPU from one task to another
+#define CONTEXT_SWITCH 0
+
+// the most CPUs that can be simulated
+#define MAX_CPUS 128
+
+// default time a task loses refilling caches after moving to another CPU
+#define MIGRATION_COST 0
+
+// default time between load balancing passes; 0 turns them off
+#define BALANCE_INTERVAL 100
+
+// length of a time quantum
+extern int quantum;
+
+// time taken to switch a CPU from one task to another
+extern int context_switch;
+
+// number of CPUs simulated
+extern int cpus;
+
+// time a task loses refilling caches after moving to another CPU
+extern int migration_cost;
+
+// time between load balancing passes; 0 turns them off
+extern int balance_interval;
+
+// a summary of one metric over every task
+struct metric {
+    double average;
+    long p99;
+    long max;
+};
+
+// what a simulation measured
+struct metrics {
+    int tasks;
+    long time;              // when the last task completed
+    double busy;            // fraction of CPU time spent running tasks
+    long switches;
+    long migrations;
+    struct metric turnaround;
+    struct metric waiting;
+    struct metric response;
+};
+
+// what the last simulation measured
+extern struct metrics metrics;
+
+// the current system time
+long current_time(void);
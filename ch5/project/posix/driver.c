@@ -3,47 +3,152 @@
  *
  * Schedule is in the format
  *
- *  [name] [priority] [CPU burst]
+ *  [name] [priority] [CPU burst] [arrival time]
+ *
+ * where the arrival time is optional, or a binary trace written by
+ * trace2bin.
+ *
+ * Usage:
+ *
+ *  ./fcfs [-s] [-q quantum] [-c context switch] [-n CPUs]
+ *         [-m migration cost] [-b balance interval]
+ *         [-o none|metrics|text] [-t timeline] [schedule]
+ *
+ * The schedule is mapped into memory and parsed in place; a binary trace
+ * is used where it is mapped, without parsing. With -s it is read a
+ * block at a time instead, and with no file, or "-", it is streamed from
+ * standard input: the simulation starts with the first block and reads
+ * the next once every task read so far has arrived, so a streamed
+ * schedule must list its tasks in arrival order. -q sets the time
+ * quantum for the algorithms that use one. -c sets the time it takes to
+ * switch a CPU from one task to another. -n simulates that many CPUs,
+ * each with its own run queue; -m sets what a task loses when it moves
+ * to another CPU and -b how often queued tasks are rebalanced (0 for
+ * never).
+ * -o chooses what is printed: nothing, only the summary, or every
+ * slice and every task's times as well (the default). -t records every
+ * slice in a binary timeline file for gantt to draw, and prints the
+ * summary.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "task.h"
 #include "list.h"
+#include "cpu.h"
 #include "schedulers.h"
-
-#define SIZE    100
+#include "trace.h"
+#include "output.h"
 
 int main(int argc, char *argv[])
 {
-    FILE *in;
-    char *temp;
-    char task[SIZE];
-
-    char *name;
-    int priority;
-    int burst;
+    int streaming = 0;
+    int in;
 
-    in = fopen(argv[1],"r");
-    
-    while (fgets(task,SIZE,in) != NULL) {
-        temp = strdup(task);
-        name = strsep(&temp,",");
-        priority = atoi(strsep(&temp,","));
-        burst = atoi(strsep(&temp,","));
+    while (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0') {
+        if (strcmp(argv[1], "-s") == 0) {
+            streaming = 1;
+        }
+        else if (strcmp(argv[1], "-q") == 0 && argc > 2) {
+            quantum = atoi(argv[2]);
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[1], "-c") == 0 && argc > 2) {
+            context_switch = atoi(argv[2]);
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[1], "-n") == 0 && argc > 2) {
+            cpus = atoi(argv[2]);
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[1], "-m") == 0 && argc > 2) {
+            migration_cost = atoi(argv[2]);
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[1], "-o") == 0 && argc > 2 && strcmp(argv[2], "none") == 0) {
+            output = OUTPUT_NONE;
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[1], "-o") == 0 && argc > 2 && strcmp(argv[2], "metrics") == 0) {
+            output = OUTPUT_METRICS;
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[1], "-o") == 0 && argc > 2 && strcmp(argv[2], "text") == 0) {
+            output = OUTPUT_TEXT;
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[1], "-t") == 0 && argc > 2) {
+            output = OUTPUT_TIMELINE;
+            timeline_path = argv[2];
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[1], "-b") == 0 && argc > 2) {
+            balance_interval = atoi(argv[2]);
+            argc--;
+            argv++;
+        }
+        else {
+            fprintf(stderr, "usage: %s [-s] [-q quantum] [-c context switch] [-n CPUs] "
+                    "[-m migration cost] [-b balance interval] [-o none|metrics|text] "
+                    "[-t timeline] [schedule]\n", argv[0]);
+            return 1;
+        }
+        argc--;
+        argv++;
+    }
 
-        // add the task to the scheduler's list of tasks
-        add(name,priority,burst);
+    if (quantum < 1) {
+        fprintf(stderr, "the quantum must be at least 1\n");
+        return 1;
+    }
+    if (cpus < 1 || cpus > MAX_CPUS) {
+        fprintf(stderr, "the number of CPUs must be between 1 and %d\n", MAX_CPUS);
+        return 1;
+    }
+    if (context_switch < 0 || migration_cost < 0) {
+        fprintf(stderr, "context switch and migration costs must not be negative\n");
+        return 1;
+    }
+    if (balance_interval < 0) {
+        fprintf(stderr, "the balance interval must not be negative (0 turns balancing off)\n");
+        return 1;
+    }
 
-        free(temp);
+    if (argc < 2 || strcmp(argv[1], "-") == 0) {
+        in = STDIN_FILENO;
+    }
+    else if (!streaming) {
+        in = -1;
+        trace_load(argv[1]);
+    }
+    else if ((in = open(argv[1], O_RDONLY)) < 0) {
+        perror(argv[1]);
+        return 1;
     }
 
-    fclose(in);
+    // a streamed schedule is read as the simulation needs its tasks
+    if (in >= 0) {
+        trace_stream_open(in);
+        more_tasks = trace_stream_more;
+    }
 
     // invoke the scheduler
     schedule();
 
+    if (in > STDIN_FILENO)
+        close(in);
+
     return 0;
 }
@@ -0,0 +1,355 @@
+/**
+ * gantt.c
+ *
+ * Draws the timeline a scheduler recorded with -t as a Gantt chart.
+ *
+ * Usage:
+ *
+ *  ./gantt [-f list|chart|svg] [-w width] [-r from,to] timeline [schedule]
+ *
+ * list prints each CPU's runs of the same task, one per line; chart
+ * draws a row of width characters per CPU, one letter per task and a
+ * dot where the CPU was idle; svg writes an SVG image width pixels wide
+ * to standard output. -r draws only the given stretch of time. With the
+ * schedule the timeline came from, tasks are labeled by name rather
+ * than by tid.
+ *
+ * For example,
+ *
+ *  ./rr -n 2 -t rr.timeline schedule.txt
+ *  ./gantt -f chart rr.timeline schedule.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "output.h"
+#include "task.h"
+#include "intern.h"
+#include "trace.h"
+
+#define FORMAT_LIST 0
+#define FORMAT_CHART 1
+#define FORMAT_SVG 2
+
+// letters for the chart, in the order tasks first appear
+static const char letters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+// height of a CPU's row in an SVG image
+#define ROW_HEIGHT 24
+
+// every slice that ran on one CPU, in order
+struct row {
+    struct timeline_slice *slice;
+    long count;
+};
+
+static struct row *rows;
+static int cpus;
+static long from, to;
+static int named;
+
+static void *allocate(size_t size) {
+    void *p = malloc(size);
+
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static void bad_timeline(const char *path, const char *what) {
+    fprintf(stderr, "%s: %s\n", path, what);
+    exit(1);
+}
+
+static const char *label(int tid) {
+    static char text[32];
+
+    if (named && tid < tasks.count)
+        return intern_name(tasks.name[tid]);
+    snprintf(text, sizeof(text), "#%d", tid);
+
+    return text;
+}
+
+// read a timeline into one row per CPU
+static void load(const char *path) {
+    const struct timeline_header *header;
+    const struct timeline_block *block;
+    const char *data, *p, *end;
+    struct stat st;
+    long *filled;
+    int fd, pass, c;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    if (st.st_size < (off_t) sizeof(struct timeline_header))
+        bad_timeline(path, "not a timeline");
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+    close(fd);
+
+    header = (const struct timeline_header *) data;
+    if (memcmp(header->magic, TIMELINE_MAGIC, sizeof(header->magic)) != 0)
+        bad_timeline(path, "not a timeline");
+    if (header->byte_order != TIMELINE_BYTE_ORDER)
+        bad_timeline(path, "timeline written with a different byte order");
+    if (header->version != TIMELINE_VERSION)
+        bad_timeline(path, "unsupported timeline version");
+    if (header->cpus < 1 || header->cpus > 65536)
+        bad_timeline(path, "corrupt timeline");
+
+    cpus = header->cpus;
+    rows = calloc(cpus, sizeof(struct row));
+    filled = calloc(cpus, sizeof(long));
+    if (rows == NULL || filled == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    // count each CPU's slices, then copy them out
+    end = data + st.st_size;
+    for (pass = 0; pass < 2; pass++) {
+        for (p = data + sizeof(struct timeline_header); p < end; ) {
+            size_t size;
+
+            block = (const struct timeline_block *) p;
+            if ((size_t) (end - p) < sizeof(*block) || block->cpu >= (uint32_t) cpus)
+                bad_timeline(path, "truncated or corrupt timeline");
+            size = sizeof(struct timeline_slice) * block->count;
+            p += sizeof(*block);
+            if ((size_t) (end - p) < size)
+                bad_timeline(path, "truncated timeline");
+
+            if (pass == 0)
+                rows[block->cpu].count += block->count;
+            else {
+                memcpy(&rows[block->cpu].slice[filled[block->cpu]], p, size);
+                filled[block->cpu] += block->count;
+            }
+            p += size;
+        }
+        if (pass == 0) {
+            for (c = 0; c < cpus; c++)
+                rows[c].slice = allocate(sizeof(struct timeline_slice) * (rows[c].count + 1));
+        }
+    }
+
+    // tids index the chart's tables, so a corrupt one must not get in
+    for (c = 0; c < cpus; c++) {
+        long i;
+
+        for (i = 0; i < rows[c].count; i++) {
+            if (rows[c].slice[i].tid < 0 || rows[c].slice[i].length < 0)
+                bad_timeline(path, "corrupt timeline");
+        }
+    }
+
+    free(filled);
+    munmap((void *) data, st.st_size);
+}
+
+// runs of the same task on each CPU, within [from, to)
+static void draw_list(void) {
+    int c;
+
+    for (c = 0; c < cpus; c++) {
+        struct timeline_slice *s = rows[c].slice;
+        long i, j;
+
+        printf("CPU %d:\n", c);
+        for (i = 0; i < rows[c].count; i = j) {
+            long start = s[i].start, finish = s[i].start + s[i].length;
+
+            // back-to-back slices of one task are one run
+            for (j = i + 1; j < rows[c].count && s[j].tid == s[i].tid && s[j].start == finish; j++)
+                finish += s[j].length;
+            if (finish <= from || start >= to)
+                continue;
+            printf("  %10ld %10ld  %s\n", start, finish, label(s[i].tid));
+        }
+    }
+}
+
+// one row of letters per CPU, each standing for (to - from) / width of time
+static void draw_chart(int width) {
+    int *letter;
+    int *legend = allocate(sizeof(int) * (sizeof(letters) - 1));
+    char *line = allocate(width + 1);
+    int used = 0, c, x, i;
+    long max_tid = 0;
+
+    for (c = 0; c < cpus; c++) {
+        for (i = 0; i < rows[c].count; i++) {
+            if (rows[c].slice[i].tid > max_tid)
+                max_tid = rows[c].slice[i].tid;
+        }
+    }
+    letter = allocate(sizeof(int) * (max_tid + 1));
+    memset(letter, -1, sizeof(int) * (max_tid + 1));
+
+    for (c = 0; c < cpus; c++) {
+        struct timeline_slice *s = rows[c].slice;
+        long k = 0;
+
+        for (x = 0; x < width; x++) {
+            // what was running in the middle of this cell
+            double t = from + (x + 0.5) * (to - from) / width;
+
+            while (k < rows[c].count && s[k].start + s[k].length <= t)
+                k++;
+            if (k == rows[c].count || s[k].start > t) {
+                line[x] = '.';
+                continue;
+            }
+            if (letter[s[k].tid] < 0 && used < (int) sizeof(letters) - 1) {
+                legend[used] = s[k].tid;
+                letter[s[k].tid] = used++;
+            }
+            line[x] = letter[s[k].tid] < 0 ? '#' : letters[letter[s[k].tid]];
+        }
+        line[width] = '\0';
+        printf("CPU %-3d |%s|\n", c, line);
+    }
+    printf("        %-10ld%*ld\n", from, width - 8, to);
+
+    for (i = 0; i < used; i++)
+        printf("%c %s\n", letters[i], label(legend[i]));
+    if (used == (int) sizeof(letters) - 1)
+        printf("# any other task\n");
+
+    free(letter);
+    free(legend);
+    free(line);
+}
+
+// write text with the characters XML gives a meaning escaped
+static void put_xml(const char *text) {
+    for (; *text != '\0'; text++) {
+        if (*text == '<')
+            fputs("&lt;", stdout);
+        else if (*text == '>')
+            fputs("&gt;", stdout);
+        else if (*text == '&')
+            fputs("&amp;", stdout);
+        else if (*text == '"')
+            fputs("&quot;", stdout);
+        else
+            putchar(*text);
+    }
+}
+
+static void draw_svg(int width) {
+    double scale = (double) width / (to - from);
+    int c;
+    long i;
+
+    printf("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+           "font-family=\"sans-serif\" font-size=\"10\">\n", width + 60, cpus * ROW_HEIGHT);
+    for (c = 0; c < cpus; c++) {
+        struct timeline_slice *s = rows[c].slice;
+        int y = c * ROW_HEIGHT;
+
+        printf("<text x=\"0\" y=\"%d\">CPU %d</text>\n", y + ROW_HEIGHT / 2 + 4, c);
+        for (i = 0; i < rows[c].count; i++) {
+            long start = s[i].start, finish = s[i].start + s[i].length;
+
+            if (finish <= from || start >= to)
+                continue;
+            if (start < from)
+                start = from;
+            if (finish > to)
+                finish = to;
+            // neighbouring tids get far apart hues
+            printf("<rect x=\"%.2f\" y=\"%d\" width=\"%.2f\" height=\"%d\" "
+                   "fill=\"hsl(%d,60%%,60%%)\"><title>",
+                   60 + (start - from) * scale, y + 2, (finish - start) * scale,
+                   ROW_HEIGHT - 4, (int) (s[i].tid * 137L % 360));
+            put_xml(label(s[i].tid));
+            printf(" %ld-%ld</title></rect>\n", (long) s[i].start,
+                   (long) (s[i].start + s[i].length));
+        }
+    }
+    printf("</svg>\n");
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-f list|chart|svg] [-w width] [-r from,to] timeline [schedule]\n",
+            program);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int format = FORMAT_LIST, width = 0, window = 0;
+    int c;
+
+    while (argc > 2 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-f") == 0 && strcmp(argv[2], "list") == 0)
+            format = FORMAT_LIST;
+        else if (strcmp(argv[1], "-f") == 0 && strcmp(argv[2], "chart") == 0)
+            format = FORMAT_CHART;
+        else if (strcmp(argv[1], "-f") == 0 && strcmp(argv[2], "svg") == 0)
+            format = FORMAT_SVG;
+        else if (strcmp(argv[1], "-w") == 0)
+            width = atoi(argv[2]);
+        else if (strcmp(argv[1], "-r") == 0 && sscanf(argv[2], "%ld,%ld", &from, &to) == 2)
+            window = 1;
+        else
+            usage(argv[0]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 2 || argc > 3)
+        usage(argv[0]);
+
+    load(argv[1]);
+    if (argc == 3) {
+        trace_load(argv[2]);
+        named = 1;
+    }
+
+    if (!window) {
+        // the whole run
+        from = 0;
+        to = 1;
+        for (c = 0; c < cpus; c++) {
+            struct timeline_slice *s = rows[c].slice;
+            long n = rows[c].count;
+
+            if (n > 0 && s[n - 1].start + s[n - 1].length > to)
+                to = s[n - 1].start + s[n - 1].length;
+        }
+    }
+    if (to <= from) {
+        fprintf(stderr, "empty time range\n");
+        return 1;
+    }
+
+    if (format == FORMAT_LIST)
+        draw_list();
+    else if (format == FORMAT_CHART)
+        draw_chart(width > 8 ? width : 72);
+    else
+        draw_svg(width > 0 ? width : 1000);
+
+    for (c = 0; c < cpus; c++)
+        free(rows[c].slice);
+    free(rows);
+    free_tasks();
+
+    return 0;
+}
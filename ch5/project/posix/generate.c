@@ -0,0 +1,395 @@
+/**
+ * generate.c
+ *
+ * Generates synthetic schedules for benchmarking the schedulers.
+ *
+ * Tasks arrive as a Poisson process, and their CPU demand follows a
+ * Pareto distribution, so most tasks are short and a few are very long.
+ * Priorities are drawn from a weighted mix. A share of the tasks can be
+ * I/O-bound: their demand is split into short CPU bursts separated by
+ * I/O waits. The simulator has no I/O, so each burst is written as a
+ * task of its own, under the same name. This is an approximation: the
+ * bursts are independent arrivals, each due a burst and a wait after
+ * the previous one arrived, as if that burst had run the moment it
+ * arrived. On a loaded system a burst waits in the run queue, so the
+ * next one can arrive before it finishes, and bursts of the same task
+ * then overlap, which a real task's bursts cannot.
+ *
+ * Tasks are written in arrival order, so the schedule can be streamed
+ * into a simulation: a burst due later is held back until every task
+ * arriving before it has been written.
+ *
+ * Usage:
+ *
+ *  ./generate [-n tasks] [-s seed] [-a mean interarrival] [-b mean burst]
+ *             [-t tail] [-m max burst] [-p priority mix] [-i I/O percent]
+ *             [-r mean I/O burst] [-w mean I/O wait] [-f text|binary]
+ *             [output]
+ *
+ * For example,
+ *
+ *  ./generate -n 1000000 -i 30 -p 1:10,5:60,10:30 -f binary big.bin
+ *
+ * writes a million tasks, 30% of them I/O-bound, with 10% at priority 1,
+ * 60% at priority 5 and 30% at priority 10, as a binary trace. The tail
+ * is the Pareto shape, above 1; the lower it is, the heavier the tail.
+ * The same seed always generates the same schedule. With no output file
+ * the schedule goes to standard output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "task.h"
+#include "intern.h"
+#include "schedulers.h"
+#include "trace.h"
+
+// size of the text output buffer
+#define BUFFER_SIZE (1 << 20)
+
+struct settings {
+    long tasks;
+    unsigned long long seed;
+    double interarrival;        // mean time between arrivals
+    double burst;               // mean CPU demand of a task
+    double tail;                // Pareto shape
+    double max_burst;           // longest CPU demand
+    int io_percent;             // share of I/O-bound tasks
+    double io_burst;            // mean CPU burst of an I/O-bound task
+    double io_wait;             // mean I/O wait
+    int weight[MAX_PRIORITY + 1];
+    int total_weight;
+};
+
+static unsigned long long state;
+
+// where each generated task goes: the text output or the task table
+static void (*emit)(long task, int priority, int burst, int arrival);
+static FILE *out;
+static char *buffer, *end;
+
+// splitmix64, so the output does not depend on the C library
+static unsigned long long next_random(void) {
+    unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+static double uniform(void) {
+    return (next_random() >> 11) * 0x1.0p-53;
+}
+
+static double exponential(double mean) {
+    return -mean * log(1 - uniform());
+}
+
+// Pareto with the given mean and shape
+static double pareto(double mean, double shape) {
+    double scale = mean * (shape - 1) / shape;
+
+    return scale / pow(1 - uniform(), 1 / shape);
+}
+
+static int pick_priority(struct settings *s) {
+    int r = next_random() % s->total_weight, p;
+
+    for (p = MIN_PRIORITY; p < MAX_PRIORITY; p++) {
+        if (r < s->weight[p])
+            break;
+        r -= s->weight[p];
+    }
+
+    return p;
+}
+
+// at least 1, and small enough for the task table
+static int clamp_time(double t) {
+    if (t >= INT_MAX) {
+        fprintf(stderr, "schedule too long: use fewer tasks or shorter bursts\n");
+        exit(1);
+    }
+
+    return t < 1 ? 1 : (int) t;
+}
+
+// a burst of an I/O-bound task that is not yet due
+struct held {
+    int arrival;
+    long task;
+    int priority;
+    int burst;
+};
+
+// bursts held back, as a binary heap ordered by arrival and then task
+static struct held *held;
+static int nheld, held_size;
+
+static int held_before(struct held *a, struct held *b) {
+    if (a->arrival != b->arrival)
+        return a->arrival < b->arrival;
+
+    return a->task < b->task;
+}
+
+// hold a burst back until it is due
+static void hold(long task, int priority, int burst, int arrival) {
+    struct held h = { arrival, task, priority, burst };
+    int i, parent;
+
+    if (nheld == held_size) {
+        held_size = held_size ? held_size * 2 : 1024;
+        if ((held = realloc(held, sizeof(struct held) * held_size)) == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    for (i = nheld++; i > 0 && held_before(&h, &held[parent = (i - 1) / 2]); i = parent)
+        held[i] = held[parent];
+    held[i] = h;
+}
+
+// write every held burst that arrives by the given time
+static void release(int arrival) {
+    while (nheld > 0 && held[0].arrival <= arrival) {
+        struct held last = held[--nheld];
+        int i = 0, child;
+
+        emit(held[0].task, held[0].priority, held[0].burst, held[0].arrival);
+
+        // sift the last burst down from the root
+        for (; (child = 2 * i + 1) < nheld; i = child) {
+            if (child + 1 < nheld && held_before(&held[child + 1], &held[child]))
+                child++;
+            if (!held_before(&held[child], &last))
+                break;
+            held[i] = held[child];
+        }
+        held[i] = last;
+    }
+}
+
+static void generate(struct settings *s) {
+    double arrival = 0;
+    long i;
+
+    state = s->seed;
+
+    for (i = 0; i < s->tasks; i++) {
+        int priority = pick_priority(s);
+        double demand = pareto(s->burst, s->tail);
+        double at;
+
+        if (demand > s->max_burst)
+            demand = s->max_burst;
+
+        if (i > 0 && s->interarrival > 0)
+            arrival += exponential(s->interarrival);
+
+        release(clamp_time(arrival + 1) - 1);
+
+        if ((long) (next_random() % 100) >= s->io_percent) {
+            emit(i, priority, clamp_time(demand), clamp_time(arrival + 1) - 1);
+            continue;
+        }
+
+        // an I/O-bound task comes back after every burst; the next
+        // burst is timed from this one's arrival, not its completion,
+        // which only the simulation knows
+        for (at = arrival; demand >= 1; ) {
+            int burst = clamp_time(exponential(s->io_burst));
+
+            if (burst > demand)
+                burst = demand;
+            // the first burst is due now, the rest later
+            (at == arrival ? emit : hold)(i, priority, burst, clamp_time(at + 1) - 1);
+            demand -= burst;
+            at += burst + exponential(s->io_wait);
+        }
+    }
+    release(INT_MAX);
+    free(held);
+}
+
+static void flush_text(void) {
+    fwrite(buffer, 1, end - buffer, out);
+    end = buffer;
+    if (ferror(out)) {
+        perror("write");
+        exit(1);
+    }
+}
+
+// append a non-negative number and a separator
+static void put_number(long n, const char *separator) {
+    char digits[24];
+    int i = sizeof(digits);
+
+    do {
+        digits[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+
+    memcpy(end, digits + i, sizeof(digits) - i);
+    end += sizeof(digits) - i;
+    while (*separator)
+        *end++ = *separator++;
+}
+
+// write a task as a line of the schedule file format, with no table
+static void emit_text(long task, int priority, int burst, int arrival) {
+    // a line is a short name and three numbers
+    if (end - buffer > BUFFER_SIZE - 128)
+        flush_text();
+    *end++ = 'T';
+    put_number(task + 1, ", ");
+    put_number(priority, ", ");
+    put_number(burst, ", ");
+    put_number(arrival, "\n");
+}
+
+// add a task to the table, for a binary trace
+static void emit_binary(long task, int priority, int burst, int arrival) {
+    static long last = -1;
+    static int name;
+
+    // the bursts of an I/O-bound task share its name
+    if (task != last) {
+        char text[32];
+
+        name = intern(text, sprintf(text, "T%ld", task + 1));
+        last = task;
+    }
+    add(name, priority, burst, arrival);
+}
+
+// parse a priority mix such as 1:10,5:60,10:30
+static void parse_mix(struct settings *s, const char *mix) {
+    char *end;
+
+    memset(s->weight, 0, sizeof(s->weight));
+    s->total_weight = 0;
+
+    do {
+        long priority = strtol(mix, &end, 10), weight;
+
+        if (end == mix || *end != ':' || priority < MIN_PRIORITY || priority > MAX_PRIORITY)
+            break;
+        mix = end + 1;
+        weight = strtol(mix, &end, 10);
+        if (end == mix || weight < 0 || weight > 1000000)
+            break;
+        s->weight[priority] += weight;
+        s->total_weight += weight;
+        mix = end + 1;
+    } while (*end == ',');
+
+    if (*end != '\0' || s->total_weight == 0) {
+        fprintf(stderr, "priority mix should look like 1:10,5:60,10:30\n");
+        exit(1);
+    }
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-n tasks] [-s seed] [-a mean interarrival] [-b mean burst] "
+            "[-t tail] [-m max burst] [-p priority mix] [-i I/O percent] "
+            "[-r mean I/O burst] [-w mean I/O wait] [-f text|binary] [output]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct settings s = {
+        .tasks = 1000000,
+        .seed = 1,
+        .interarrival = 10,
+        .burst = 20,
+        .tail = 1.5,
+        .max_burst = 100000,
+        .io_percent = 0,
+        .io_burst = 2,
+        .io_wait = 50,
+    };
+    int binary = 0, p;
+
+    for (p = MIN_PRIORITY; p <= MAX_PRIORITY; p++)
+        s.weight[p] = 1;
+    s.total_weight = MAX_PRIORITY - MIN_PRIORITY + 1;
+
+    while (argc > 2 && argv[1][0] == '-' && argv[1][1] != '\0') {
+        if (strcmp(argv[1], "-n") == 0)
+            s.tasks = atol(argv[2]);
+        else if (strcmp(argv[1], "-s") == 0)
+            s.seed = strtoull(argv[2], NULL, 10);
+        else if (strcmp(argv[1], "-a") == 0)
+            s.interarrival = atof(argv[2]);
+        else if (strcmp(argv[1], "-b") == 0)
+            s.burst = atof(argv[2]);
+        else if (strcmp(argv[1], "-t") == 0)
+            s.tail = atof(argv[2]);
+        else if (strcmp(argv[1], "-m") == 0)
+            s.max_burst = atof(argv[2]);
+        else if (strcmp(argv[1], "-p") == 0)
+            parse_mix(&s, argv[2]);
+        else if (strcmp(argv[1], "-i") == 0)
+            s.io_percent = atoi(argv[2]);
+        else if (strcmp(argv[1], "-r") == 0)
+            s.io_burst = atof(argv[2]);
+        else if (strcmp(argv[1], "-w") == 0)
+            s.io_wait = atof(argv[2]);
+        else if (strcmp(argv[1], "-f") == 0 && strcmp(argv[2], "binary") == 0)
+            binary = 1;
+        else if (strcmp(argv[1], "-f") == 0 && strcmp(argv[2], "text") == 0)
+            binary = 0;
+        else
+            usage(argv[0]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-' && argv[1][1] != '\0'))
+        usage(argv[0]);
+
+    if (s.tasks < 0 || s.tasks > INT_MAX || s.interarrival < 0 || s.burst < 1 || s.tail <= 1
+            || s.max_burst < 1 || s.io_percent < 0 || s.io_percent > 100
+            || s.io_burst < 1 || s.io_wait < 0) {
+        fprintf(stderr, "%s: a setting is out of range\n", argv[0]);
+        return 1;
+    }
+
+    out = stdout;
+    if (argc == 2 && strcmp(argv[1], "-") != 0 && (out = fopen(argv[1], "wb")) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    if (binary) {
+        emit = emit_binary;
+        generate(&s);
+        trace_save(out);
+        free_tasks();
+    }
+    else {
+        if ((buffer = malloc(BUFFER_SIZE)) == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        end = buffer;
+        emit = emit_text;
+        generate(&s);
+        flush_text();
+        free(buffer);
+    }
+
+    if (fclose(out) != 0) {
+        perror("write");
+        return 1;
+    }
+
+    return 0;
+}
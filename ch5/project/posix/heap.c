@@ -0,0 +1,136 @@
+/**
+ * Indexed binary heap operations
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "heap.h"
+#include "task.h"
+
+// true if entry a should leave the heap before entry b
+static int before(struct heap_entry *a, struct heap_entry *b) {
+    if (a->key != b->key)
+        return a->key < b->key;
+
+    return a->tid < b->tid;
+}
+
+// grow an array, exiting if memory runs out
+static void *grow(void *array, size_t size) {
+    void *grown = realloc(array, size);
+
+    if (grown == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    return grown;
+}
+
+// put an entry at position i and remember where it went
+static void place(struct heap *h, int i, struct heap_entry entry) {
+    h->entry[i] = entry;
+    tasks.heap_index[entry.tid] = i;
+}
+
+// move the entry at position i up towards the root
+static void sift_up(struct heap *h, int i) {
+    struct heap_entry entry = h->entry[i];
+    int parent;
+
+    for (; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (!before(&entry, &h->entry[parent]))
+            break;
+        place(h, i, h->entry[parent]);
+    }
+    place(h, i, entry);
+}
+
+// move the entry at position i down towards the leaves
+static void sift_down(struct heap *h, int i) {
+    struct heap_entry entry = h->entry[i];
+    int child;
+
+    for (; (child = 2 * i + 1) < h->size; i = child) {
+        if (child + 1 < h->size && before(&h->entry[child + 1], &h->entry[child]))
+            child++;
+        if (!before(&h->entry[child], &entry))
+            break;
+        place(h, i, h->entry[child]);
+    }
+    place(h, i, entry);
+}
+
+// take the entry at position i out of the heap
+static int take(struct heap *h, int i) {
+    int tid = h->entry[i].tid;
+
+    tasks.heap_index[tid] = -1;
+    if (--h->size > i) {
+        // fill the hole with the last entry, which may belong
+        // either above or below it
+        place(h, i, h->entry[h->size]);
+        if (i > 0 && before(&h->entry[i], &h->entry[(i - 1) / 2]))
+            sift_up(h, i);
+        else
+            sift_down(h, i);
+    }
+
+    return tid;
+}
+
+void heap_init(struct heap *h) {
+    h->entry = NULL;
+    h->size = 0;
+    h->capacity = 0;
+}
+
+void heap_free(struct heap *h) {
+    free(h->entry);
+    heap_init(h);
+}
+
+// add a task to the heap
+void heap_insert(struct heap *h, int tid, long key) {
+    if (h->size == h->capacity) {
+        h->capacity = h->capacity ? h->capacity * 2 : 64;
+        h->entry = grow(h->entry, sizeof(struct heap_entry) * h->capacity);
+    }
+
+    h->entry[h->size].key = key;
+    h->entry[h->size].tid = tid;
+    sift_up(h, h->size++);
+}
+
+// remove and return the first task, or -1 if the heap is empty
+int heap_extract(struct heap *h) {
+    if (h->size == 0)
+        return -1;
+
+    return take(h, 0);
+}
+
+// return the first task without removing it, or -1 if the heap is empty
+int heap_peek(struct heap *h) {
+    return h->size ? h->entry[0].tid : -1;
+}
+
+// return the key of the first task; the heap must not be empty
+long heap_peek_key(struct heap *h) {
+    return h->entry[0].key;
+}
+
+// remove the given task
+// returns 0 if successful or 1 if the task is not in the heap
+int heap_remove(struct heap *h, int tid) {
+    int i = tasks.heap_index[tid];
+
+    if (i < 0 || i >= h->size || h->entry[i].tid != tid)
+        return 1;
+
+    take(h, i);
+
+    return 0;
+}
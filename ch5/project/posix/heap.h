@@ -0,0 +1,37 @@
+/**
+ * Indexed binary min-heap of tasks, used as a ready queue.
+ *
+ * Tasks are ordered by a key chosen by the scheduler (burst, priority,
+ * ...), ties going to the task added to the system first. The heap
+ * records every task's position in the task table (a task is in at
+ * most one heap at a time), so a task can be found and removed without
+ * searching.
+ */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "task.h"
+
+struct heap_entry {
+    long key;
+    int tid;
+};
+
+struct heap {
+    struct heap_entry *entry;
+    int size;
+    int capacity;
+};
+
+void heap_init(struct heap *h);
+void heap_free(struct heap *h);
+
+// insert, extract and remove operations.
+void heap_insert(struct heap *h, int tid, long key);
+int heap_extract(struct heap *h);
+int heap_peek(struct heap *h);
+long heap_peek_key(struct heap *h);
+int heap_remove(struct heap *h, int tid);
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * Name interning
+ *
+ * Names are copied into large arena chunks, so a trace with millions of
+ * tasks costs one allocation per chunk rather than one per name. An open
+ * addressing hash table maps each name to its number, and an array maps
+ * the number back to the copy.
+ *
+ * A binary trace brings its own string table, which is used where it is
+ * mapped instead.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "intern.h"
+
+#define CHUNK_SIZE (1 << 20)
+
+// the arena chunk being filled
+static char *chunk;
+static size_t chunk_used, chunk_size;
+
+// every interned name, by number
+static char **names;
+static int count, names_size;
+
+// a mapped string table and where each name starts in it
+static const char *mapped_strings;
+static const unsigned int *mapped_offsets;
+
+// hash table of name numbers, -1 for an empty slot;
+// size is a power of two
+static int *table;
+static size_t table_size;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+}
+
+// FNV-1a
+static uint64_t hash(const char *name, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char) name[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+// copy a name into the arena
+static char *store(const char *name, size_t len) {
+    char *copy;
+
+    if (chunk == NULL || chunk_used + len + 1 > chunk_size) {
+        // names longer than a chunk get a chunk of their own
+        chunk_size = len + 1 > CHUNK_SIZE ? len + 1 : CHUNK_SIZE;
+        if ((chunk = malloc(chunk_size)) == NULL)
+            out_of_memory();
+        chunk_used = 0;
+    }
+
+    copy = chunk + chunk_used;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    chunk_used += len + 1;
+
+    return copy;
+}
+
+// double the hash table
+static void rehash(void) {
+    size_t size = table_size ? table_size * 2 : 1024;
+    int *grown = malloc(size * sizeof(int));
+    size_t i, j;
+
+    if (grown == NULL)
+        out_of_memory();
+    memset(grown, -1, size * sizeof(int));
+
+    for (i = 0; i < table_size; i++) {
+        if (table[i] < 0)
+            continue;
+        j = hash(names[table[i]], strlen(names[table[i]])) & (size - 1);
+        while (grown[j] >= 0)
+            j = (j + 1) & (size - 1);
+        grown[j] = table[i];
+    }
+
+    free(table);
+    table = grown;
+    table_size = size;
+}
+
+int intern(const char *name, size_t len) {
+    size_t i;
+
+    if (mapped_strings != NULL) {
+        fprintf(stderr, "cannot add names to a mapped trace\n");
+        exit(1);
+    }
+
+    // keep the table at most half full
+    if (2 * ((size_t) count + 1) > table_size)
+        rehash();
+
+    i = hash(name, len) & (table_size - 1);
+    while (table[i] >= 0) {
+        const char *known = names[table[i]];
+
+        if (strncmp(known, name, len) == 0 && known[len] == '\0')
+            return table[i];
+        i = (i + 1) & (table_size - 1);
+    }
+
+    if (count == names_size) {
+        names_size = names_size ? names_size * 2 : 1024;
+        if ((names = realloc(names, sizeof(char *) * names_size)) == NULL)
+            out_of_memory();
+    }
+    names[count] = store(name, len);
+
+    return table[i] = count++;
+}
+
+const char *intern_name(int id) {
+    if (mapped_strings != NULL)
+        return mapped_strings + mapped_offsets[id];
+
+    return names[id];
+}
+
+int intern_count(void) {
+    return count;
+}
+
+void intern_map(const char *strings, const unsigned int *offsets, int n) {
+    if (count > 0) {
+        fprintf(stderr, "a mapped trace must be the only schedule\n");
+        exit(1);
+    }
+
+    mapped_strings = strings;
+    mapped_offsets = offsets;
+    count = n;
+}
@@ -0,0 +1,28 @@
+/**
+ * Interned task names.
+ *
+ * Every distinct name is stored once, NUL-terminated, in a growing
+ * arena, and numbered in the order it was first seen; interning the
+ * same name again returns the same number.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+// return the number of the len bytes at name, interning them if new
+int intern(const char *name, size_t len);
+
+// the name with the given number
+const char *intern_name(int id);
+
+// number of distinct names interned so far
+int intern_count(void);
+
+// use a string table mapped from a binary trace as the names, where
+// name number i starts at strings + offsets[i]; nothing more can be
+// interned afterwards
+void intern_map(const char *strings, const unsigned int *offsets, int count);
+
+#endif
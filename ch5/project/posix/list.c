@@ -4,52 +4,85 @@
  
 #include <stdlib.h>
 #include <stdio.h>
-#include <string.h>
 
 #include "list.h"
 #include "task.h"
+#include "intern.h"
 
+void list_init(struct list *list) {
+    list->head = list->tail = -1;
+}
 
-// add a new task to the list of tasks
-void insert(struct node **head, Task *newTask) {
-    // add the new task to the list 
-    struct node *newNode = malloc(sizeof(struct node));
-
-    newNode->task = newTask;
-    newNode->next = *head;
-    *head = newNode;
+// add a new task to the front of the list
+void insert(struct list *list, int tid) {
+    tasks.next[tid] = list->head;
+    list->head = tid;
+    if (list->tail < 0)
+        list->tail = tid;
 }
 
 // delete the selected task from the list
-void delete(struct node **head, Task *task) {
-    struct node *temp;
-    struct node *prev;
-
-    temp = *head;
-    // special case - beginning of list
-    if (strcmp(task->name,temp->task->name) == 0) {
-        *head = (*head)->next;
-    }
-    else {
-        // interior or last element in the list
-        prev = *head;
-        temp = temp->next;
-        while (strcmp(task->name,temp->task->name) != 0) {
-            prev = temp;
-            temp = temp->next;
-        }
-
-        prev->next = temp->next;
+void delete(struct list *list, int tid) {
+    int prev = -1, temp = list->head;
+
+    while (temp >= 0 && temp != tid) {
+        prev = temp;
+        temp = tasks.next[temp];
     }
+    if (temp < 0)
+        return;
+
+    if (prev < 0)
+        list->head = tasks.next[tid];
+    else
+        tasks.next[prev] = tasks.next[tid];
+    if (list->tail == tid)
+        list->tail = prev;
+    tasks.next[tid] = -1;
 }
 
 // traverse the list
-void traverse(struct node *head) {
-    struct node *temp;
-    temp = head;
+void traverse(struct list *list) {
+    int temp;
 
-    while (temp != NULL) {
-        printf("[%s] [%d] [%d]\n",temp->task->name, temp->task->priority, temp->task->burst);
-        temp = temp->next;
-    }
+    for (temp = list->head; temp >= 0; temp = tasks.next[temp])
+        printf("[%s] [%d] [%d]\n", intern_name(tasks.name[temp]), tasks.priority[temp], tasks.burst[temp]);
+}
+
+// add a new task to the end of the list
+void append(struct list *list, int tid) {
+    tasks.next[tid] = -1;
+    if (list->head < 0)
+        list->head = tid;
+    else
+        tasks.next[list->tail] = tid;
+    list->tail = tid;
+}
+
+// remove the first task from the list, or return -1 if it is empty
+int take_first(struct list *list) {
+    int tid = list->head;
+
+    if (tid < 0)
+        return -1;
+
+    list->head = tasks.next[tid];
+    if (list->head < 0)
+        list->tail = -1;
+    tasks.next[tid] = -1;
+
+    return tid;
+}
+
+// move every task of the other list to the end of this one
+void concat(struct list *list, struct list *other) {
+    if (other->head < 0)
+        return;
+
+    if (list->head < 0)
+        list->head = other->head;
+    else
+        tasks.next[list->tail] = other->head;
+    list->tail = other->tail;
+    list_init(other);
 }
@@ -1,15 +1,30 @@
 /**
  * list data structure containing the tasks in the system
+ *
+ * Lists are threaded through the task table (tasks.next), so a task can
+ * be on one list at a time and lists never allocate.
  */
 
+#ifndef LIST_H
+#define LIST_H
+
 #include "task.h"
 
-struct node {
-    Task *task;
-    struct node *next;
+struct list {
+    int head;       // first tid, or -1
+    int tail;       // last tid, or -1
 };
 
+void list_init(struct list *list);
+
 // insert and delete operations.
-void insert(struct node **head, Task *task);
-void delete(struct node **head, Task *task);
-void traverse(struct node *head);
+void insert(struct list *list, int tid);
+void delete(struct list *list, int tid);
+void traverse(struct list *list);
+
+// first-in first-out operations.
+void append(struct list *list, int tid);
+int take_first(struct list *list);
+void concat(struct list *list, struct list *other);
+
+#endif
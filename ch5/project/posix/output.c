@@ -0,0 +1,192 @@
+/**
+ * Output sinks
+ *
+ * Text is formatted by hand into one large buffer and handed to stdio a
+ * buffer at a time; the timeline keeps a block of slices per CPU and
+ * writes each block as it fills.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "output.h"
+#include "task.h"
+#include "cpu.h"
+#include "intern.h"
+
+// size of the text buffer
+#define BUFFER_SIZE (1 << 20)
+
+// room for the longest line other than the name
+#define LINE_SIZE 192
+
+int output = OUTPUT_TEXT;
+const char *timeline_path = "timeline.bin";
+void (*output_slice)(int cpu, int tid, long start, int length);
+
+static char *buffer, *end;
+
+// a block of slices for each CPU
+static struct timeline_slice *blocks;
+static int *filled;
+static FILE *timeline;
+
+static void *allocate(size_t size) {
+    void *p = malloc(size);
+
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static void flush_text(void) {
+    fwrite(buffer, 1, end - buffer, stdout);
+    end = buffer;
+}
+
+static void put_string(const char *s) {
+    size_t len = strlen(s);
+
+    if (len > BUFFER_SIZE - LINE_SIZE - (end - buffer)) {
+        flush_text();
+        // a name longer than the buffer goes straight through
+        if (len > BUFFER_SIZE - LINE_SIZE) {
+            fwrite(s, 1, len, stdout);
+            return;
+        }
+    }
+    memcpy(end, s, len);
+    end += len;
+}
+
+static void put_number(long n) {
+    char digits[24];
+    int i = sizeof(digits);
+    int negative = n < 0;
+
+    if (negative)
+        n = -n;
+    do {
+        digits[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    if (negative)
+        digits[--i] = '-';
+
+    memcpy(end, digits + i, sizeof(digits) - i);
+    end += sizeof(digits) - i;
+}
+
+// "Running task = [T1] [4] [20] for 10 units.", as in the book; with
+// more than one CPU, "CPU 1 at 30: " goes first, since slices overlap
+static void text_slice(int cpu, int tid, long start, int length) {
+    if (end - buffer > BUFFER_SIZE - LINE_SIZE)
+        flush_text();
+
+    if (cpus > 1) {
+        memcpy(end, "CPU ", 4);
+        end += 4;
+        put_number(cpu);
+        memcpy(end, " at ", 4);
+        end += 4;
+        put_number(start);
+        memcpy(end, ": ", 2);
+        end += 2;
+    }
+    memcpy(end, "Running task = [", 16);
+    end += 16;
+    put_string(intern_name(tasks.name[tid]));
+    memcpy(end, "] [", 3);
+    end += 3;
+    put_number(tasks.priority[tid]);
+    memcpy(end, "] [", 3);
+    end += 3;
+    put_number(tasks.burst[tid]);
+    memcpy(end, "] for ", 6);
+    end += 6;
+    put_number(length);
+    memcpy(end, " units.\n", 8);
+    end += 8;
+}
+
+static void write_block(int cpu) {
+    struct timeline_block header = { cpu, filled[cpu] };
+
+    if (filled[cpu] == 0)
+        return;
+    fwrite(&header, sizeof(header), 1, timeline);
+    fwrite(&blocks[(size_t) cpu * TIMELINE_BLOCK], sizeof(struct timeline_slice), filled[cpu], timeline);
+    filled[cpu] = 0;
+}
+
+static void timeline_slice(int cpu, int tid, long start, int length) {
+    struct timeline_slice *slice = &blocks[(size_t) cpu * TIMELINE_BLOCK + filled[cpu]];
+
+    slice->start = start;
+    slice->tid = tid;
+    slice->length = length;
+    if (++filled[cpu] == TIMELINE_BLOCK)
+        write_block(cpu);
+}
+
+// the timeline's header, rewritten at the end once the tasks are counted
+static struct timeline_header head;
+
+void output_begin(void) {
+    output_slice = NULL;
+
+    if (output == OUTPUT_TEXT) {
+        buffer = end = allocate(BUFFER_SIZE);
+        output_slice = text_slice;
+    }
+    else if (output == OUTPUT_TIMELINE) {
+        if ((timeline = fopen(timeline_path, "wb")) == NULL) {
+            perror(timeline_path);
+            exit(1);
+        }
+        memset(&head, 0, sizeof(head));
+        memcpy(head.magic, TIMELINE_MAGIC, sizeof(head.magic));
+        head.version = TIMELINE_VERSION;
+        head.byte_order = TIMELINE_BYTE_ORDER;
+        head.cpus = cpus;
+        head.tasks = tasks.count;
+        fwrite(&head, sizeof(head), 1, timeline);
+
+        blocks = allocate(sizeof(struct timeline_slice) * TIMELINE_BLOCK * cpus);
+        filled = calloc(cpus, sizeof(int));
+        if (filled == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        output_slice = timeline_slice;
+    }
+}
+
+void output_end(void) {
+    int c;
+
+    if (output == OUTPUT_TEXT) {
+        flush_text();
+        free(buffer);
+    }
+    else if (output == OUTPUT_TIMELINE) {
+        for (c = 0; c < cpus; c++)
+            write_block(c);
+        // a streamed schedule may have grown since the header was written
+        if (head.tasks != (uint32_t) tasks.count && fseek(timeline, 0, SEEK_SET) == 0) {
+            head.tasks = tasks.count;
+            fwrite(&head, sizeof(head), 1, timeline);
+        }
+        if (ferror(timeline) || fclose(timeline) != 0) {
+            perror(timeline_path);
+            exit(1);
+        }
+        free(blocks);
+        free(filled);
+    }
+    output_slice = NULL;
+}
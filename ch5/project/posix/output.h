@@ -0,0 +1,72 @@
+/**
+ * Where a simulation's output goes.
+ *
+ * Every slice a CPU runs goes to a sink chosen before the simulation
+ * starts:
+ *
+ *  OUTPUT_NONE      nothing at all; the metrics are only measured
+ *  OUTPUT_METRICS   no slices, only the summary at the end
+ *  OUTPUT_TEXT      a line per slice, and every task's times
+ *  OUTPUT_TIMELINE  slices recorded in a binary timeline file, for
+ *                   gantt to draw, and the summary
+ *
+ * When no sink wants slices, output_slice is NULL and a slice costs the
+ * simulator one test.
+ *
+ * A timeline file is a header followed by blocks of slices, each block
+ * holding the slices of one CPU in the order they ran. Numbers are in
+ * the byte order of the machine that wrote it.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+
+#define OUTPUT_NONE 0
+#define OUTPUT_METRICS 1
+#define OUTPUT_TEXT 2
+#define OUTPUT_TIMELINE 3
+
+#define TIMELINE_MAGIC "SCHEDTML"
+#define TIMELINE_VERSION 1
+#define TIMELINE_BYTE_ORDER 0x01020304
+
+// the most slices in one block
+#define TIMELINE_BLOCK 4096
+
+struct timeline_header {
+    char magic[8];              // TIMELINE_MAGIC, without its NUL
+    uint32_t version;           // TIMELINE_VERSION
+    uint32_t byte_order;        // TIMELINE_BYTE_ORDER, as the writer stored it
+    uint32_t cpus;
+    uint32_t tasks;
+};
+
+struct timeline_block {
+    uint32_t cpu;
+    uint32_t count;             // slices that follow
+};
+
+struct timeline_slice {
+    int64_t start;
+    int32_t tid;
+    int32_t length;
+};
+
+// the chosen sink
+extern int output;
+
+// the file OUTPUT_TIMELINE writes to
+extern const char *timeline_path;
+
+// hand a slice to the sink, or NULL if it does not want them
+extern void (*output_slice)(int cpu, int tid, long start, int length);
+
+// get the sink ready for a simulation
+void output_begin(void);
+
+// write out whatever the sink still holds
+void output_end(void);
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * Red-black tree operations
+ *
+ * These follow Cormen et al., Introduction to Algorithms, chapter 13,
+ * with a sentinel leaf per tree.
+ */
+
+#include <stdlib.h>
+
+#include "rbtree.h"
+
+// true if node a belongs to the left of node b
+static int before(struct rb_node *a, struct rb_node *b) {
+    if (a->key != b->key)
+        return a->key < b->key;
+
+    return a->tid < b->tid;
+}
+
+static void rotate_left(struct rbtree *tree, struct rb_node *x) {
+    struct rb_node *y = x->right;
+
+    x->right = y->left;
+    if (y->left != &tree->nil)
+        y->left->parent = x;
+    y->parent = x->parent;
+    if (x->parent == &tree->nil)
+        tree->root = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+static void rotate_right(struct rbtree *tree, struct rb_node *x) {
+    struct rb_node *y = x->left;
+
+    x->left = y->right;
+    if (y->right != &tree->nil)
+        y->right->parent = x;
+    y->parent = x->parent;
+    if (x->parent == &tree->nil)
+        tree->root = y;
+    else if (x == x->parent->right)
+        x->parent->right = y;
+    else
+        x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+void rb_init(struct rbtree *tree) {
+    tree->nil.left = tree->nil.right = tree->nil.parent = &tree->nil;
+    tree->nil.red = 0;
+    tree->root = &tree->nil;
+}
+
+void rb_insert(struct rbtree *tree, struct rb_node *z) {
+    struct rb_node *y = &tree->nil, *x = tree->root;
+
+    while (x != &tree->nil) {
+        y = x;
+        x = before(z, x) ? x->left : x->right;
+    }
+
+    z->parent = y;
+    if (y == &tree->nil)
+        tree->root = z;
+    else if (before(z, y))
+        y->left = z;
+    else
+        y->right = z;
+    z->left = z->right = &tree->nil;
+    z->red = 1;
+
+    // restore the red-black properties
+    while (z->parent->red) {
+        struct rb_node *g = z->parent->parent;
+
+        if (z->parent == g->left) {
+            y = g->right;
+            if (y->red) {
+                z->parent->red = 0;
+                y->red = 0;
+                g->red = 1;
+                z = g;
+            }
+            else {
+                if (z == z->parent->right) {
+                    z = z->parent;
+                    rotate_left(tree, z);
+                }
+                z->parent->red = 0;
+                z->parent->parent->red = 1;
+                rotate_right(tree, z->parent->parent);
+            }
+        }
+        else {
+            y = g->left;
+            if (y->red) {
+                z->parent->red = 0;
+                y->red = 0;
+                g->red = 1;
+                z = g;
+            }
+            else {
+                if (z == z->parent->left) {
+                    z = z->parent;
+                    rotate_right(tree, z);
+                }
+                z->parent->red = 0;
+                z->parent->parent->red = 1;
+                rotate_left(tree, z->parent->parent);
+            }
+        }
+    }
+    tree->root->red = 0;
+}
+
+// put subtree v where subtree u was
+static void transplant(struct rbtree *tree, struct rb_node *u, struct rb_node *v) {
+    if (u->parent == &tree->nil)
+        tree->root = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+    v->parent = u->parent;
+}
+
+static struct rb_node *minimum(struct rbtree *tree, struct rb_node *x) {
+    while (x->left != &tree->nil)
+        x = x->left;
+
+    return x;
+}
+
+void rb_erase(struct rbtree *tree, struct rb_node *z) {
+    struct rb_node *x, *y = z, *w;
+    int y_was_red = y->red;
+
+    if (z->left == &tree->nil) {
+        x = z->right;
+        transplant(tree, z, z->right);
+    }
+    else if (z->right == &tree->nil) {
+        x = z->left;
+        transplant(tree, z, z->left);
+    }
+    else {
+        y = minimum(tree, z->right);
+        y_was_red = y->red;
+        x = y->right;
+        if (y->parent == z) {
+            x->parent = y;
+        }
+        else {
+            transplant(tree, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        transplant(tree, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->red = z->red;
+    }
+
+    if (y_was_red)
+        return;
+
+    // restore the red-black properties
+    while (x != tree->root && !x->red) {
+        if (x == x->parent->left) {
+            w = x->parent->right;
+            if (w->red) {
+                w->red = 0;
+                x->parent->red = 1;
+                rotate_left(tree, x->parent);
+                w = x->parent->right;
+            }
+            if (!w->left->red && !w->right->red) {
+                w->red = 1;
+                x = x->parent;
+            }
+            else {
+                if (!w->right->red) {
+                    w->left->red = 0;
+                    w->red = 1;
+                    rotate_right(tree, w);
+                    w = x->parent->right;
+                }
+                w->red = x->parent->red;
+                x->parent->red = 0;
+                w->right->red = 0;
+                rotate_left(tree, x->parent);
+                x = tree->root;
+            }
+        }
+        else {
+            w = x->parent->left;
+            if (w->red) {
+                w->red = 0;
+                x->parent->red = 1;
+                rotate_right(tree, x->parent);
+                w = x->parent->left;
+            }
+            if (!w->right->red && !w->left->red) {
+                w->red = 1;
+                x = x->parent;
+            }
+            else {
+                if (!w->left->red) {
+                    w->right->red = 0;
+                    w->red = 1;
+                    rotate_left(tree, w);
+                    w = x->parent->left;
+                }
+                w->red = x->parent->red;
+                x->parent->red = 0;
+                w->left->red = 0;
+                rotate_right(tree, x->parent);
+                x = tree->root;
+            }
+        }
+    }
+    x->red = 0;
+}
+
+struct rb_node *rb_first(struct rbtree *tree) {
+    if (tree->root == &tree->nil)
+        return NULL;
+
+    return minimum(tree, tree->root);
+}
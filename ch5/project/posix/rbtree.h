@@ -0,0 +1,34 @@
+/**
+ * Red-black tree of tasks, ordered by a key such as virtual runtime.
+ *
+ * Nodes live in the caller's own storage; the tree never allocates.
+ * Equal keys are ordered by tid.
+ */
+
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include "task.h"
+
+struct rb_node {
+    struct rb_node *left, *right, *parent;
+    int red;
+    long key;
+    int tid;
+};
+
+struct rbtree {
+    struct rb_node *root;
+    struct rb_node nil;     // shared leaf, so no child pointer is NULL
+};
+
+void rb_init(struct rbtree *tree);
+
+// insert and erase operations.
+void rb_insert(struct rbtree *tree, struct rb_node *node);
+void rb_erase(struct rbtree *tree, struct rb_node *node);
+
+// the node with the smallest key, or NULL if the tree is empty
+struct rb_node *rb_first(struct rbtree *tree);
+
+#endif
@@ -0,0 +1,174 @@
+/**
+ * Completely fair scheduling, after Linux's CFS.
+ *
+ * Every task accumulates virtual runtime: the time it has run, scaled
+ * down by its weight, so a heavier task ages more slowly. The ready
+ * queue is a red-black tree ordered by virtual runtime and the task
+ * that has had least runs next, for its share of CFS_LATENCY in
+ * proportion to its weight, but never less than CFS_MIN_GRANULARITY.
+ *
+ * Priorities 1 to 10 map onto the nice values 19 to -20, and nice
+ * values onto weights with the kernel's table, so each step of nice is
+ * about a 10% change in CPU share.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+#include "task.h"
+#include "rbtree.h"
+#include "cpu.h"
+#include "schedulers.h"
+
+// period in which every ready task should get to run once; a long, as
+// the quantum may be large
+#ifndef CFS_LATENCY
+#define CFS_LATENCY (4 * (long) quantum)
+#endif
+
+// the shortest slice a task is given
+#ifndef CFS_MIN_GRANULARITY
+#define CFS_MIN_GRANULARITY (quantum / 2 > 0 ? quantum / 2 : 1)
+#endif
+
+// the weight of nice 0
+#define NICE_0_WEIGHT 1024
+
+// virtual runtime is kept in units of 1/VRUNTIME_SCALE of a time unit
+#define VRUNTIME_SCALE 1024
+
+// weight of nice -20 to 19, from the Linux kernel
+static const int nice_to_weight[40] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,
+     3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,
+      335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,
+       36,    29,    23,    18,    15,
+};
+
+// a run queue per CPU
+static struct rbtree ready[MAX_CPUS];
+static long load[MAX_CPUS];             // total weight of queued tasks
+static long min_vruntime[MAX_CPUS];
+
+// tree nodes are allocated this many at a time and never move, since
+// the trees point at them, so there is room for tasks read mid-run
+#define NODE_CHUNK 4096
+
+#define NODE(tid) (&node[(tid) / NODE_CHUNK][(tid) % NODE_CHUNK])
+
+// what the scheduler remembers about each task, by tid; a node's key
+// is the task's virtual runtime
+static struct rb_node **node;
+static int *weight;
+static short *queue;            // the run queue it was last on, or -1
+static int *last_remaining;     // the task's remaining time when last queued
+static int capacity;            // tasks the arrays have room for
+
+// nice value for a priority: the highest priority is nice -20
+static int nice_of(int priority) {
+    return 19 - (priority - MIN_PRIORITY) * 39 / (MAX_PRIORITY - MIN_PRIORITY);
+}
+
+// add a task to the run queue, charging it for the time it has run
+static void enqueue(int cpu, int tid) {
+    struct rb_node *n = NODE(tid);
+
+    if (queue[tid] < 0) {
+        // a new task starts level with the tasks already waiting
+        n->tid = tid;
+        n->key = min_vruntime[cpu];
+        weight[tid] = nice_to_weight[nice_of(tasks.priority[tid]) + 20];
+    }
+    else {
+        n->key += (long) (last_remaining[tid] - tasks.remaining[tid])
+            * NICE_0_WEIGHT * VRUNTIME_SCALE / weight[tid];
+
+        // moving to another CPU keeps its place relative to the others
+        if (queue[tid] != cpu)
+            n->key += min_vruntime[cpu] - min_vruntime[queue[tid]];
+
+        // a task that has been away may not bank more than a period
+        if (n->key < min_vruntime[cpu] - (long) CFS_LATENCY * VRUNTIME_SCALE)
+            n->key = min_vruntime[cpu] - (long) CFS_LATENCY * VRUNTIME_SCALE;
+    }
+    queue[tid] = cpu;
+    last_remaining[tid] = tasks.remaining[tid];
+
+    rb_insert(&ready[cpu], n);
+    load[cpu] += weight[tid];
+}
+
+// the task with the least virtual runtime runs for its share of the period
+static int pick_next_task(int cpu, int *slice) {
+    struct rb_node *first = rb_first(&ready[cpu]);
+    long share;
+    int tid;
+
+    if (first == NULL)
+        return -1;
+
+    tid = first->tid;
+    share = (long) CFS_LATENCY * weight[tid] / load[cpu];
+    if (share < CFS_MIN_GRANULARITY)
+        share = CFS_MIN_GRANULARITY;
+    *slice = share > INT_MAX ? INT_MAX : (int) share;
+
+    rb_erase(&ready[cpu], first);
+    load[cpu] -= weight[tid];
+    if (first->key > min_vruntime[cpu])
+        min_vruntime[cpu] = first->key;
+
+    return tid;
+}
+
+// make room for more tasks, as the task table grows
+static void grow(int needed) {
+    int chunks = (needed + NODE_CHUNK - 1) / NODE_CHUNK;
+    int c, tid;
+
+    node = realloc(node, sizeof(struct rb_node *) * chunks);
+    weight = realloc(weight, sizeof(int) * needed);
+    queue = realloc(queue, sizeof(short) * needed);
+    last_remaining = realloc(last_remaining, sizeof(int) * needed);
+    if (node == NULL || weight == NULL || queue == NULL || last_remaining == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (c = (capacity + NODE_CHUNK - 1) / NODE_CHUNK; c < chunks; c++) {
+        if ((node[c] = malloc(sizeof(struct rb_node) * NODE_CHUNK)) == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    for (tid = capacity; tid < needed; tid++)
+        queue[tid] = -1;
+    capacity = needed;
+}
+
+static struct scheduler cfs = { enqueue, pick_next_task, grow };
+
+// invoke the scheduler
+void schedule() {
+    int cpu, c;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++)
+        rb_init(&ready[cpu]);
+
+    simulate(&cfs);
+
+    for (c = 0; c < (capacity + NODE_CHUNK - 1) / NODE_CHUNK; c++)
+        free(node[c]);
+    free(node);
+    free(weight);
+    free(queue);
+    free(last_remaining);
+    node = NULL;
+    weight = last_remaining = NULL;
+    queue = NULL;
+    capacity = 0;
+}
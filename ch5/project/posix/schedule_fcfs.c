@@ -0,0 +1,41 @@
+/**
+ * First-come, first-served scheduling.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "task.h"
+#include "list.h"
+#include "cpu.h"
+#include "schedulers.h"
+
+// one ready queue per CPU
+static struct list ready[MAX_CPUS];
+
+// add a task to the end of the ready queue
+static void enqueue(int cpu, int tid) {
+    append(&ready[cpu], tid);
+}
+
+// the task that has waited longest runs until it is done
+static int pick_next_task(int cpu, int *slice) {
+    int tid = take_first(&ready[cpu]);
+
+    if (tid >= 0)
+        *slice = tasks.remaining[tid];
+
+    return tid;
+}
+
+static struct scheduler fcfs = { enqueue, pick_next_task };
+
+// invoke the scheduler
+void schedule() {
+    int cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++)
+        list_init(&ready[cpu]);
+
+    simulate(&fcfs);
+}
@@ -0,0 +1,142 @@
+/**
+ * Multilevel feedback queue scheduling.
+ *
+ * New tasks start in the top level. A task that uses up its whole time
+ * quantum moves down a level, where the quantum is longer; the first
+ * task of the highest non-empty level runs next. Every MLFQ_BOOST time
+ * units all tasks go back to the top level, so long-running tasks are
+ * not starved.
+ *
+ * The quanta, and with them the number of levels, and the boost period
+ * can be set when building, e.g.
+ *
+ *  make mlfq CFLAGS="-Wall -DMLFQ_QUANTA='{5,10,20,40}' -DMLFQ_BOOST=200"
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+#include "task.h"
+#include "list.h"
+#include "cpu.h"
+#include "schedulers.h"
+
+// time quantum of each level, top level first, for the default
+// quantum; they scale with the quantum in use
+#ifndef MLFQ_QUANTA
+#define MLFQ_QUANTA { QUANTUM, 2 * QUANTUM, 4 * QUANTUM }
+#endif
+
+// time between moving every task back to the top level
+#ifndef MLFQ_BOOST
+#define MLFQ_BOOST 1000
+#endif
+
+static const int quanta[] = MLFQ_QUANTA;
+
+#define LEVELS ((int) (sizeof(quanta) / sizeof(quanta[0])))
+
+// one ready queue per level on each CPU
+static struct list ready[MAX_CPUS][LEVELS];
+
+// what the scheduler remembers about each task, by tid
+static int *level;
+static int *boosted;        // boosts so far when the level was set, or -1
+static int *last_remaining; // the task's remaining time when last queued
+static int capacity;        // tasks the arrays have room for
+
+static int boosts;
+static long next_boost = MLFQ_BOOST;
+
+// move every queued task back to the top level
+static void boost(void) {
+    int cpu, l;
+
+    for (cpu = 0; cpu < cpus; cpu++) {
+        for (l = 1; l < LEVELS; l++)
+            concat(&ready[cpu][0], &ready[cpu][l]);
+    }
+
+    // tasks that are running now will find their level is stale
+    boosts++;
+}
+
+// add a task to the ready queue of its level
+static void enqueue(int cpu, int tid) {
+    if (boosted[tid] != boosts) {
+        // a new task, or one that was running during a boost
+        level[tid] = 0;
+        boosted[tid] = boosts;
+    }
+    else if (tasks.remaining[tid] < last_remaining[tid] && level[tid] < LEVELS - 1) {
+        // it ran since it was last queued, and was preempted
+        level[tid]++;
+    }
+    last_remaining[tid] = tasks.remaining[tid];
+
+    append(&ready[cpu][level[tid]], tid);
+}
+
+// the first task of the highest level runs for that level's quantum
+static int pick_next_task(int cpu, int *slice) {
+    long scaled;
+    int tid, l;
+
+    if (MLFQ_BOOST > 0 && current_time() >= next_boost) {
+        boost();
+        next_boost = current_time() - current_time() % MLFQ_BOOST + MLFQ_BOOST;
+    }
+
+    for (l = 0; l < LEVELS; l++) {
+        if (ready[cpu][l].head >= 0)
+            break;
+    }
+    if (l == LEVELS)
+        return -1;
+
+    tid = take_first(&ready[cpu][l]);
+    level[tid] = l;
+    boosted[tid] = boosts;
+    // the quanta scale with the quantum in use, which may be large
+    scaled = (long) quanta[l] * quantum / QUANTUM;
+    *slice = scaled < 1 ? 1 : scaled > INT_MAX ? INT_MAX : (int) scaled;
+
+    return tid;
+}
+
+// make room for more tasks, as the task table grows
+static void grow(int needed) {
+    int tid;
+
+    level = realloc(level, sizeof(int) * needed);
+    boosted = realloc(boosted, sizeof(int) * needed);
+    last_remaining = realloc(last_remaining, sizeof(int) * needed);
+    if (level == NULL || boosted == NULL || last_remaining == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (tid = capacity; tid < needed; tid++)
+        boosted[tid] = -1;
+    capacity = needed;
+}
+
+static struct scheduler mlfq = { enqueue, pick_next_task, grow };
+
+// invoke the scheduler
+void schedule() {
+    int cpu, l;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        for (l = 0; l < LEVELS; l++)
+            list_init(&ready[cpu][l]);
+    }
+
+    simulate(&mlfq);
+
+    free(level);
+    free(boosted);
+    free(last_remaining);
+    level = boosted = last_remaining = NULL;
+    capacity = 0;
+}
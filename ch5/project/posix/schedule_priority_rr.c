@@ -0,0 +1,50 @@
+/**
+ * Priority scheduling with round-robin among tasks of equal priority.
+ *
+ * There is one ready queue per priority level. The highest non-empty
+ * level always runs next, its tasks taking turns a quantum at a time;
+ * a task that is alone at its level simply keeps the CPU.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "task.h"
+#include "list.h"
+#include "cpu.h"
+#include "schedulers.h"
+
+// one ready queue per priority on each CPU
+static struct list ready[MAX_CPUS][MAX_PRIORITY + 1];
+
+// add a task to the end of its priority's ready queue
+static void enqueue(int cpu, int tid) {
+    append(&ready[cpu][tasks.priority[tid]], tid);
+}
+
+// the first task of the highest priority runs for one quantum
+static int pick_next_task(int cpu, int *slice) {
+    int priority;
+
+    *slice = quantum;
+    for (priority = MAX_PRIORITY; priority >= MIN_PRIORITY; priority--) {
+        if (ready[cpu][priority].head >= 0)
+            return take_first(&ready[cpu][priority]);
+    }
+
+    return -1;
+}
+
+static struct scheduler priority_rr = { enqueue, pick_next_task };
+
+// invoke the scheduler
+void schedule() {
+    int cpu, priority;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        for (priority = 0; priority <= MAX_PRIORITY; priority++)
+            list_init(&ready[cpu][priority]);
+    }
+
+    simulate(&priority_rr);
+}
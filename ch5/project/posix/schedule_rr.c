@@ -0,0 +1,41 @@
+/**
+ * Round-robin scheduling.
+ *
+ * Each task runs for at most one time quantum, then goes to the back of
+ * the ready queue.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "task.h"
+#include "list.h"
+#include "cpu.h"
+#include "schedulers.h"
+
+// one ready queue per CPU
+static struct list ready[MAX_CPUS];
+
+// add a task to the end of the ready queue
+static void enqueue(int cpu, int tid) {
+    append(&ready[cpu], tid);
+}
+
+// the task at the front of the queue runs for one quantum
+static int pick_next_task(int cpu, int *slice) {
+    *slice = quantum;
+
+    return take_first(&ready[cpu]);
+}
+
+static struct scheduler rr = { enqueue, pick_next_task };
+
+// invoke the scheduler
+void schedule() {
+    int cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++)
+        list_init(&ready[cpu]);
+
+    simulate(&rr);
+}
@@ -0,0 +1,43 @@
+/**
+ * Shortest-job-first scheduling.
+ *
+ * The ready queue is a heap keyed by CPU burst, so picking the next
+ * task costs O(log n) rather than a walk over every waiting task.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "task.h"
+#include "heap.h"
+#include "cpu.h"
+#include "schedulers.h"
+
+// one ready queue per CPU
+static struct heap ready[MAX_CPUS];
+
+// add a task to the ready queue
+static void enqueue(int cpu, int tid) {
+    heap_insert(&ready[cpu], tid, tasks.burst[tid]);
+}
+
+// the shortest ready task runs until it is done
+static int pick_next_task(int cpu, int *slice) {
+    int tid = heap_extract(&ready[cpu]);
+
+    if (tid >= 0)
+        *slice = tasks.remaining[tid];
+
+    return tid;
+}
+
+static struct scheduler sjf = { enqueue, pick_next_task };
+
+// invoke the scheduler
+void schedule() {
+    int cpu;
+
+    simulate(&sjf);
+    for (cpu = 0; cpu < MAX_CPUS; cpu++)
+        heap_free(&ready[cpu]);
+}
@@ -1,8 +1,41 @@
+#ifndef SCHEDULERS_H
+#define SCHEDULERS_H
+
+#include "task.h"
+
 #define MIN_PRIORITY 1
 #define MAX_PRIORITY 10
 
-// add a task to the list 
-void add(char *name, int priority, int burst);
+// a scheduling algorithm, as seen by the simulated CPUs. every CPU
+// has its own run queue; cpu says which one to use. tasks are named
+// by tid, their index in the task table.
+struct scheduler {
+    // a task has arrived, used up its time slice without finishing,
+    // or is being moved here from another CPU
+    void (*enqueue)(int cpu, int tid);
+
+    // remove and return the next task to run, setting how long it may
+    // run before it is preempted, or return -1 if no task is ready
+    int (*pick_next_task)(int cpu, int *slice);
+
+    // the task table has grown to hold capacity tasks: make room for as
+    // many in the algorithm's own per-task arrays. NULL if it has none.
+    void (*grow)(int capacity);
+};
+
+// add a task, with an interned name, to the list 
+void add(int name, int priority, int burst, int arrival);
 
 // invoke the scheduler
 void schedule();
+
+// run every task under the given algorithm, then report on them
+void simulate(struct scheduler *scheduler);
+
+// reads the next part of a schedule that is still being loaded, adding
+// its tasks; returns 0 once the whole schedule is in. simulate calls it
+// whenever every task added so far has arrived, so a streamed schedule
+// is simulated as it is read. NULL when the schedule is loaded first.
+extern int (*more_tasks)(void);
+
+#endif
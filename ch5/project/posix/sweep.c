@@ -0,0 +1,355 @@
+/**
+ * sweep.c
+ *
+ * Runs one schedule under many configurations: every combination of
+ * scheduling algorithm, time quantum and number of CPUs. The schedule
+ * is loaded once; each configuration then runs in a child process,
+ * which shares the loaded tasks with the parent until it writes to
+ * them, and sends its metrics back through a pipe. As many children
+ * run at once as there are CPUs online.
+ *
+ * Usage:
+ *
+ *  ./sweep [-j jobs] [-f csv|json] [-p algorithms] [-q quanta] [-n CPUs]
+ *          [-c context switch] [-m migration cost] [-b balance interval]
+ *          schedule
+ *
+ * where algorithms, quanta and CPUs are comma-separated lists, e.g.
+ *
+ *  ./sweep -p rr,mlfq,cfs -q 5,10,20 -n 1,8,32 schedule.txt
+ *
+ * One row of metrics per configuration is printed, in CSV or as JSON
+ * lines, in the order the configurations are listed. A configuration
+ * whose child dies without a result is reported on stderr and skipped,
+ * and sweep then exits with status 1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "task.h"
+#include "cpu.h"
+#include "schedulers.h"
+#include "trace.h"
+#include "output.h"
+
+// the longest list of values for one parameter
+#define MAX_VALUES 64
+
+// each algorithm's schedule(), renamed when built for the sweep
+void schedule_fcfs();
+void schedule_sjf();
+void schedule_rr();
+void schedule_priority();
+void schedule_priority_rr();
+void schedule_mlfq();
+void schedule_cfs();
+
+static struct {
+    const char *name;
+    void (*schedule)();
+} algorithms[] = {
+    { "fcfs", schedule_fcfs },
+    { "sjf", schedule_sjf },
+    { "rr", schedule_rr },
+    { "priority", schedule_priority },
+    { "priority_rr", schedule_priority_rr },
+    { "mlfq", schedule_mlfq },
+    { "cfs", schedule_cfs },
+};
+
+#define ALGORITHMS ((int) (sizeof(algorithms) / sizeof(algorithms[0])))
+
+// one combination of parameters
+struct config {
+    int algorithm;
+    int quantum;
+    int cpus;
+};
+
+// how far a configuration got
+#define WAITING 0   // not run, or still running
+#define DONE 1      // its result has been read
+#define FAILED 2    // its child exited without sending a result
+
+// what a child sends back; small enough for the write to be atomic
+struct result {
+    int index;
+    struct metrics metrics;
+};
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-j jobs] [-f csv|json] [-p algorithms] [-q quanta] "
+            "[-n CPUs] [-c context switch] [-m migration cost] "
+            "[-b balance interval] schedule\n", program);
+    exit(1);
+}
+
+// split a comma-separated list of numbers
+static int parse_numbers(const char *list, int *values, int min, int max) {
+    int n = 0;
+    char *end;
+
+    do {
+        long value = strtol(list, &end, 10);
+
+        if (end == list || value < min || value > max || n == MAX_VALUES) {
+            fprintf(stderr, "bad value in list: %s\n", list);
+            exit(1);
+        }
+        values[n++] = value;
+        list = end + 1;
+    } while (*end == ',');
+
+    if (*end != '\0') {
+        fprintf(stderr, "bad value in list: %s\n", end);
+        exit(1);
+    }
+
+    return n;
+}
+
+// split a comma-separated list of algorithm names
+static int parse_algorithms(const char *list, int *values) {
+    int n = 0;
+
+    while (*list != '\0') {
+        size_t len = strcspn(list, ",");
+        int a;
+
+        for (a = 0; a < ALGORITHMS; a++) {
+            if (strlen(algorithms[a].name) == len && strncmp(algorithms[a].name, list, len) == 0)
+                break;
+        }
+        if (a == ALGORITHMS || n == MAX_VALUES) {
+            fprintf(stderr, "unknown algorithm: %.*s\n", (int) len, list);
+            exit(1);
+        }
+        values[n++] = a;
+        list += len;
+        if (*list == ',')
+            list++;
+    }
+
+    return n;
+}
+
+// run one configuration in this process and send back its metrics
+static void run_config(int out, int index, struct config *config) {
+    struct result result;
+
+    quantum = config->quantum;
+    cpus = config->cpus;
+    output = OUTPUT_NONE;
+    algorithms[config->algorithm].schedule();
+
+    result.index = index;
+    result.metrics = metrics;
+    if (write(out, &result, sizeof(result)) != sizeof(result))
+        _exit(1);
+    _exit(0);
+}
+
+static void print_header(int json) {
+    if (!json)
+        printf("algorithm,quantum,cpus,tasks,time,busy,context_switches,migrations,"
+               "turnaround_avg,turnaround_p99,turnaround_max,"
+               "waiting_avg,waiting_p99,waiting_max,"
+               "response_avg,response_p99,response_max\n");
+}
+
+static void print_row(int json, struct config *config, struct metrics *m) {
+    const char *format = json
+        ? "{\"algorithm\":\"%s\",\"quantum\":%d,\"cpus\":%d,\"tasks\":%d,\"time\":%ld,"
+          "\"busy\":%.4f,\"context_switches\":%ld,\"migrations\":%ld,"
+          "\"turnaround_avg\":%.2f,\"turnaround_p99\":%ld,\"turnaround_max\":%ld,"
+          "\"waiting_avg\":%.2f,\"waiting_p99\":%ld,\"waiting_max\":%ld,"
+          "\"response_avg\":%.2f,\"response_p99\":%ld,\"response_max\":%ld}\n"
+        : "%s,%d,%d,%d,%ld,%.4f,%ld,%ld,%.2f,%ld,%ld,%.2f,%ld,%ld,%.2f,%ld,%ld\n";
+
+    printf(format, algorithms[config->algorithm].name, config->quantum, config->cpus,
+           m->tasks, m->time, m->busy, m->switches, m->migrations,
+           m->turnaround.average, m->turnaround.p99, m->turnaround.max,
+           m->waiting.average, m->waiting.p99, m->waiting.max,
+           m->response.average, m->response.p99, m->response.max);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *program = argv[0];
+    int algorithm_list[MAX_VALUES], quantum_list[MAX_VALUES] = { QUANTUM }, cpu_list[MAX_VALUES] = { 1 };
+    int nalgorithms = 0, nquanta = 1, ncpus = 1;
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int json = 0;
+    struct config *configs;
+    struct metrics *results;
+    char *done;
+    pid_t *child;   // the child running in each job slot, 0 if none
+    int *running_config;
+    int nconfigs, started = 0, running = 0, printed = 0, failed = 0;
+    int fd[2];
+    int a, q, n, i;
+
+    while (argc > 2 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-j") == 0)
+            jobs = atoi(argv[2]);
+        else if (strcmp(argv[1], "-f") == 0 && strcmp(argv[2], "json") == 0)
+            json = 1;
+        else if (strcmp(argv[1], "-f") == 0 && strcmp(argv[2], "csv") == 0)
+            json = 0;
+        else if (strcmp(argv[1], "-p") == 0)
+            nalgorithms = parse_algorithms(argv[2], algorithm_list);
+        else if (strcmp(argv[1], "-q") == 0)
+            nquanta = parse_numbers(argv[2], quantum_list, 1, 1 << 30);
+        else if (strcmp(argv[1], "-n") == 0)
+            ncpus = parse_numbers(argv[2], cpu_list, 1, MAX_CPUS);
+        else if (strcmp(argv[1], "-c") == 0)
+            context_switch = atoi(argv[2]);
+        else if (strcmp(argv[1], "-m") == 0)
+            migration_cost = atoi(argv[2]);
+        else if (strcmp(argv[1], "-b") == 0)
+            balance_interval = atoi(argv[2]);
+        else
+            usage(program);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 2 || context_switch < 0 || migration_cost < 0 || balance_interval < 0)
+        usage(program);
+    if (jobs < 1)
+        jobs = 1;
+
+    if (nalgorithms == 0) {
+        for (a = 0; a < ALGORITHMS; a++)
+            algorithm_list[nalgorithms++] = a;
+    }
+
+    // load the schedule once; every child shares it
+    trace_load(argv[1]);
+
+    nconfigs = nalgorithms * nquanta * ncpus;
+    configs = malloc(sizeof(struct config) * nconfigs);
+    results = malloc(sizeof(struct metrics) * nconfigs);
+    done = calloc(nconfigs, 1);
+    child = calloc(jobs, sizeof(pid_t));
+    running_config = malloc(sizeof(int) * jobs);
+    if (configs == NULL || results == NULL || done == NULL || child == NULL
+            || running_config == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    i = 0;
+    for (a = 0; a < nalgorithms; a++) {
+        for (q = 0; q < nquanta; q++) {
+            for (n = 0; n < ncpus; n++) {
+                configs[i].algorithm = algorithm_list[a];
+                configs[i].quantum = quantum_list[q];
+                configs[i].cpus = cpu_list[n];
+                i++;
+            }
+        }
+    }
+
+    if (pipe(fd) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    // results are read whenever there are any, so never block
+    fcntl(fd[0], F_SETFL, O_NONBLOCK);
+
+    print_header(json);
+    fflush(stdout);
+
+    while (started < nconfigs || running > 0) {
+        struct pollfd ready = { fd[0], POLLIN, 0 };
+        struct result result;
+        int status;
+        pid_t pid;
+
+        if (running < jobs && started < nconfigs) {
+            for (i = 0; child[i] != 0; i++)
+                ;
+            pid = fork();
+
+            if (pid < 0) {
+                perror("fork");
+                return 1;
+            }
+            if (pid == 0) {
+                close(fd[0]);
+                run_config(fd[1], started, &configs[started]);
+            }
+            child[i] = pid;
+            running_config[i] = started;
+            started++;
+            running++;
+            continue;
+        }
+
+        // read results while the children run, so that none blocks on a
+        // full pipe. a child that dies without one does not wake us, so
+        // look for exits every so often too.
+        if (poll(&ready, 1, 10) < 0 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (i = 0; i < jobs && child[i] != pid; i++)
+                ;
+            if (i == jobs)
+                continue;
+            // failed unless its result is read, now or below
+            if (done[running_config[i]] == WAITING)
+                done[running_config[i]] = FAILED;
+            child[i] = 0;
+            running--;
+        }
+        if (pid < 0 && errno == ECHILD) {
+            // nothing left to reap, whatever we counted
+            for (i = 0; i < jobs; i++) {
+                if (child[i] != 0 && done[running_config[i]] == WAITING)
+                    done[running_config[i]] = FAILED;
+                child[i] = 0;
+            }
+            running = 0;
+        }
+
+        // a child writes its result before it exits
+        while (read(fd[0], &result, sizeof(result)) == sizeof(result)) {
+            results[result.index] = result.metrics;
+            done[result.index] = DONE;
+        }
+
+        // print in order, as far as the results go; a failed
+        // configuration is reported and skipped
+        for (; printed < nconfigs && done[printed] != WAITING; printed++) {
+            if (done[printed] == DONE) {
+                print_row(json, &configs[printed], &results[printed]);
+                continue;
+            }
+            fprintf(stderr, "%s -q %d -n %d: no result\n",
+                    algorithms[configs[printed].algorithm].name,
+                    configs[printed].quantum, configs[printed].cpus);
+            failed++;
+        }
+        fflush(stdout);
+    }
+
+    if (failed > 0)
+        fprintf(stderr, "%d configurations failed\n", failed);
+
+    free(configs);
+    free(results);
+    free(done);
+    free(child);
+    free(running_config);
+    free_tasks();
+
+    return failed > 0;
+}
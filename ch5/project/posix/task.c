@@ -0,0 +1,91 @@
+/**
+ * The task table
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "task.h"
+#include "schedulers.h"
+
+struct task_table tasks;
+
+// grow one column of the table
+static void *grow(void *column, size_t size) {
+    void *grown = realloc(column, size * tasks.capacity);
+
+    if (grown == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    return grown;
+}
+
+// add a task to the list of tasks in the system
+void add(int name, int priority, int burst, int arrival) {
+    int tid = tasks.count;
+
+    if (tasks.mapped) {
+        fprintf(stderr, "a mapped trace must be the only schedule\n");
+        exit(1);
+    }
+    if (tasks.count == tasks.capacity) {
+        tasks.capacity = tasks.capacity ? tasks.capacity * 2 : 1024;
+        tasks.name = grow(tasks.name, sizeof(int));
+        tasks.priority = grow(tasks.priority, sizeof(unsigned char));
+        tasks.burst = grow(tasks.burst, sizeof(int));
+        tasks.arrival = grow(tasks.arrival, sizeof(int));
+        tasks.remaining = grow(tasks.remaining, sizeof(int));
+        tasks.start = grow(tasks.start, sizeof(long));
+        tasks.finish = grow(tasks.finish, sizeof(long));
+        tasks.cpu = grow(tasks.cpu, sizeof(short));
+        tasks.next = grow(tasks.next, sizeof(int));
+        tasks.heap_index = grow(tasks.heap_index, sizeof(int));
+    }
+
+    tasks.name[tid] = name;
+    tasks.priority[tid] = priority;
+    tasks.burst[tid] = burst;
+    tasks.arrival[tid] = arrival;
+    // the rest is set when the task arrives (see CPU.c)
+    tasks.count++;
+}
+
+void map_tasks(int count, int *name, unsigned char *priority, int *burst, int *arrival) {
+    if (tasks.count > 0) {
+        fprintf(stderr, "a mapped trace must be the only schedule\n");
+        exit(1);
+    }
+
+    tasks.count = tasks.capacity = count;
+    tasks.mapped = 1;
+    tasks.name = name;
+    tasks.priority = priority;
+    tasks.burst = burst;
+    tasks.arrival = arrival;
+
+    // left untouched until the tasks arrive, so no page is faulted in yet
+    tasks.remaining = grow(NULL, sizeof(int));
+    tasks.start = grow(NULL, sizeof(long));
+    tasks.finish = grow(NULL, sizeof(long));
+    tasks.cpu = grow(NULL, sizeof(short));
+    tasks.next = grow(NULL, sizeof(int));
+    tasks.heap_index = grow(NULL, sizeof(int));
+}
+
+void free_tasks(void) {
+    if (!tasks.mapped) {
+        free(tasks.name);
+        free(tasks.priority);
+        free(tasks.burst);
+        free(tasks.arrival);
+    }
+    free(tasks.remaining);
+    free(tasks.start);
+    free(tasks.finish);
+    free(tasks.cpu);
+    free(tasks.next);
+    free(tasks.heap_index);
+    tasks.count = tasks.capacity = tasks.mapped = 0;
+}
@@ -1,16 +1,46 @@
 /**
- * Representation of a task in the system.
+ * Representation of the tasks in the system.
+ *
+ * Tasks are stored column by column rather than one struct per task:
+ * a task's tid is its index into every array. Schedulers pass tids
+ * around, and a pass over one attribute, such as every burst, reads
+ * only that attribute's memory.
  */
 
 #ifndef TASK_H
 #define TASK_H
 
-// representation of a task
-typedef struct task {
-    char *name;
-    int tid;
-    int priority;
-    int burst;
-} Task;
+// the tasks in the system
+struct task_table {
+    int count;
+    int capacity;
+    int mapped;                 // the schedule columns belong to a mapped trace
+
+    // from the schedule
+    int *name;                  // interned name (see intern.h)
+    unsigned char *priority;
+    int *burst;
+    int *arrival;               // when the task enters the system
+
+    // kept by the simulated CPUs
+    int *remaining;             // CPU time the task still needs
+    long *start;                // when the task first ran, or -1
+    long *finish;               // when the task completed
+    short *cpu;                 // the CPU the task last ran on, or -1
+
+    // links for whichever ready queue or heap holds the task
+    int *next;                  // next task in the same list, or -1
+    int *heap_index;            // position in a heap, or -1
+};
+
+// every task in the system
+extern struct task_table tasks;
+
+// use columns mapped from a binary trace (see trace.h) as the schedule,
+// in place of tasks added one at a time
+void map_tasks(int count, int *name, unsigned char *priority, int *burst, int *arrival);
+
+// release the task table
+void free_tasks(void);
 
 #endif
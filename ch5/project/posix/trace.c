@@ -0,0 +1,356 @@
+/**
+ * Schedule file loaders
+ *
+ * The file is tokenized where it lies, in the mapping or the read
+ * buffer: no line is copied, and only names are kept, in the intern
+ * arena.
+ *
+ * A binary trace is checked and then left mapped for the rest of the
+ * run, with the task table and the names pointing into it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+#include "intern.h"
+#include "task.h"
+#include "schedulers.h"
+
+// size of a streaming read
+#define BLOCK_SIZE (1 << 20)
+
+// the line being parsed, for error messages
+static long line;
+
+static void malformed(const char *what) {
+    fprintf(stderr, "line %ld: %s\n", line, what);
+    exit(1);
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+
+    return p;
+}
+
+// parse a non-negative decimal number, leaving p after it
+static int parse_number(const char **p, const char *end, const char *what) {
+    const char *s = skip_blanks(*p, end);
+    long value = 0;
+
+    if (s == end || *s < '0' || *s > '9')
+        malformed(what);
+
+    for (; s < end && *s >= '0' && *s <= '9'; s++) {
+        value = value * 10 + (*s - '0');
+        if (value > 0x7fffffff)
+            malformed(what);
+    }
+
+    *p = skip_blanks(s, end);
+    return (int) value;
+}
+
+// parse one line, which runs from p up to end without its newline
+static void parse_line(const char *p, const char *end) {
+    const char *start, *comma;
+    int name, priority, burst, arrival = 0;
+
+    line++;
+
+    p = skip_blanks(p, end);
+    if (p == end)
+        return;
+
+    start = p;
+    if ((comma = memchr(p, ',', end - p)) == NULL)
+        malformed("expected name, priority, burst");
+
+    // trim trailing blanks from the name
+    for (p = comma; p > start && (p[-1] == ' ' || p[-1] == '\t'); p--)
+        ;
+    if (p == start)
+        malformed("missing name");
+    name = intern(start, p - start);
+
+    p = comma + 1;
+    priority = parse_number(&p, end, "bad priority");
+    if (priority < MIN_PRIORITY || priority > MAX_PRIORITY)
+        malformed("priority out of range");
+    if (p == end || *p++ != ',')
+        malformed("expected name, priority, burst");
+    burst = parse_number(&p, end, "bad burst");
+    if (burst < 1)
+        malformed("bad burst");
+    if (p != end && *p == ',') {
+        p++;
+        arrival = parse_number(&p, end, "bad arrival");
+    }
+    if (p != end)
+        malformed("trailing characters");
+
+    // add the task to the scheduler's list of tasks
+    add(name, priority, burst, arrival);
+}
+
+// parse every complete line between p and end
+// returns the start of the unfinished last line
+static const char *parse_lines(const char *p, const char *end) {
+    const char *newline;
+
+    while ((newline = memchr(p, '\n', end - p)) != NULL) {
+        parse_line(p, newline);
+        p = newline + 1;
+    }
+
+    return p;
+}
+
+static void bad_trace(const char *path, const char *what) {
+    fprintf(stderr, "%s: %s\n", path, what);
+    exit(1);
+}
+
+// a binary trace starts with the magic number, then the version and
+// the byte order mark, which hold NULs no text schedule has; a text
+// schedule whose first name merely begins with the magic is still text
+static int is_binary(const char *data, size_t size) {
+    const struct trace_header *h = (const struct trace_header *) data;
+
+    if (size < sizeof(struct trace_header)
+            || memcmp(data, TRACE_MAGIC, sizeof(TRACE_MAGIC) - 1) != 0)
+        return 0;
+    if (memchr(data + sizeof(h->magic), '\0', sizeof(h->version) + sizeof(h->byte_order)) == NULL)
+        return 0;
+
+    // written on this machine or one of the other byte order
+    return h->byte_order == TRACE_BYTE_ORDER || h->byte_order == 0x04030201;
+}
+
+// check that a block of length bytes at offset lies inside the file
+static void *block(const char *path, const char *data, size_t size, uint64_t offset, uint64_t length) {
+    if (offset % TRACE_ALIGN != 0 || offset > size || length > size - offset)
+        bad_trace(path, "truncated or corrupt trace");
+
+    return (void *) (data + offset);
+}
+
+// point the task table and the names at a mapped binary trace
+static void map_trace(const char *path, const char *data, size_t size) {
+    const struct trace_header *h = (const struct trace_header *) data;
+    const char *strings;
+    const unsigned int *offsets;
+    int *name, *burst, *arrival;
+    unsigned char *priority;
+    uint64_t i;
+
+    if (size < sizeof(struct trace_header))
+        bad_trace(path, "truncated trace header");
+    if (h->byte_order != TRACE_BYTE_ORDER)
+        bad_trace(path, "trace written with a different byte order");
+    if (h->version != TRACE_VERSION)
+        bad_trace(path, "unsupported trace version");
+    if (h->tasks > INT_MAX || h->names > INT_MAX || h->string_bytes > UINT_MAX)
+        bad_trace(path, "too many tasks");
+
+    strings = block(path, data, size, h->strings, h->string_bytes);
+    if (h->names > 0 && (h->string_bytes == 0 || strings[h->string_bytes - 1] != '\0'))
+        bad_trace(path, "unterminated string table");
+
+    offsets = block(path, data, size, h->offsets, h->names * sizeof(uint32_t));
+    name = block(path, data, size, h->name, h->tasks * sizeof(int32_t));
+    priority = block(path, data, size, h->priority, h->tasks * sizeof(uint8_t));
+    burst = block(path, data, size, h->burst, h->tasks * sizeof(int32_t));
+    arrival = block(path, data, size, h->arrival, h->tasks * sizeof(int32_t));
+
+    // the columns index tables and go into the simulation as they are,
+    // so every row gets the checks parse_line makes on a text line
+    for (i = 0; i < h->names; i++) {
+        if (offsets[i] >= h->string_bytes)
+            bad_trace(path, "name offset out of range");
+    }
+    for (i = 0; i < h->tasks; i++) {
+        if (name[i] < 0 || (uint64_t) name[i] >= h->names)
+            bad_trace(path, "name out of range");
+        if (priority[i] < MIN_PRIORITY || priority[i] > MAX_PRIORITY)
+            bad_trace(path, "priority out of range");
+        if (burst[i] < 1)
+            bad_trace(path, "bad burst");
+        if (arrival[i] < 0)
+            bad_trace(path, "bad arrival");
+    }
+
+    intern_map(strings, offsets, h->names);
+    map_tasks(h->tasks, name, priority, burst, arrival);
+}
+
+void trace_load(const char *path) {
+    struct stat st;
+    const char *data, *rest;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+
+    line = 0;
+    if (st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        // not something we can map, such as a pipe
+        trace_stream(fd);
+        close(fd);
+        return;
+    }
+    close(fd);
+
+    if (is_binary(data, st.st_size)) {
+        map_trace(path, data, st.st_size);
+        return;
+    }
+
+    madvise((void *) data, st.st_size, MADV_SEQUENTIAL);
+
+    rest = parse_lines(data, data + st.st_size);
+    if (rest < data + st.st_size)
+        parse_line(rest, data + st.st_size);
+
+    munmap((void *) data, st.st_size);
+}
+
+// the schedule being streamed: its file, the read buffer, and the
+// unfinished line kept at the front of the buffer
+static int stream_fd = -1;
+static char *stream_buffer;
+static size_t kept;
+
+void trace_stream_open(int fd) {
+    if ((stream_buffer = malloc(BLOCK_SIZE)) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    stream_fd = fd;
+    kept = 0;
+    line = 0;
+}
+
+int trace_stream_more(void) {
+    const char *end, *rest;
+    ssize_t n;
+
+    if (stream_buffer == NULL)
+        return 0;
+
+    if ((n = read(stream_fd, stream_buffer + kept, BLOCK_SIZE - kept)) < 0) {
+        perror("read");
+        exit(1);
+    }
+    if (n == 0) {
+        // the last line may have no newline
+        if (kept > 0)
+            parse_line(stream_buffer, stream_buffer + kept);
+        free(stream_buffer);
+        stream_buffer = NULL;
+        stream_fd = -1;
+        return 0;
+    }
+
+    end = stream_buffer + kept + n;
+    if (line == 0 && is_binary(stream_buffer, end - stream_buffer)) {
+        fprintf(stderr, "a binary trace cannot be streamed; give its file name\n");
+        exit(1);
+    }
+    rest = parse_lines(stream_buffer, end);
+
+    // move the unfinished line to the front of the buffer
+    kept = end - rest;
+    if (kept == BLOCK_SIZE)
+        malformed("line too long");
+    memmove(stream_buffer, rest, kept);
+
+    return 1;
+}
+
+void trace_stream(int fd) {
+    trace_stream_open(fd);
+    while (trace_stream_more())
+        ;
+}
+
+static uint64_t align(uint64_t offset) {
+    return (offset + TRACE_ALIGN - 1) / TRACE_ALIGN * TRACE_ALIGN;
+}
+
+// write a block at offset, padding from where the last one ended
+static void write_block(FILE *out, uint64_t *written, uint64_t offset, const void *data, size_t length) {
+    static const char zeros[TRACE_ALIGN];
+
+    fwrite(zeros, 1, offset - *written, out);
+    fwrite(data, 1, length, out);
+    *written = offset + length;
+}
+
+void trace_save(FILE *out) {
+    struct trace_header h;
+    uint32_t *offsets;
+    uint64_t written = 0;
+    int names = intern_count(), i;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    h.version = TRACE_VERSION;
+    h.byte_order = TRACE_BYTE_ORDER;
+    h.tasks = tasks.count;
+    h.names = names;
+
+    if ((offsets = malloc(sizeof(uint32_t) * (names + 1))) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < names; i++) {
+        offsets[i] = h.string_bytes;
+        h.string_bytes += strlen(intern_name(i)) + 1;
+        if (h.string_bytes > UINT_MAX) {
+            fprintf(stderr, "names too long for a trace\n");
+            exit(1);
+        }
+    }
+
+    h.offsets = align(sizeof(h));
+    h.strings = align(h.offsets + sizeof(uint32_t) * h.names);
+    h.name = align(h.strings + h.string_bytes);
+    h.priority = align(h.name + sizeof(int32_t) * h.tasks);
+    h.burst = align(h.priority + sizeof(uint8_t) * h.tasks);
+    h.arrival = align(h.burst + sizeof(int32_t) * h.tasks);
+
+    write_block(out, &written, 0, &h, sizeof(h));
+    write_block(out, &written, h.offsets, offsets, sizeof(uint32_t) * h.names);
+    for (i = 0; i < names; i++) {
+        const char *name = intern_name(i);
+
+        write_block(out, &written, i == 0 ? h.strings : written, name, strlen(name) + 1);
+    }
+    write_block(out, &written, h.name, tasks.name, sizeof(int32_t) * h.tasks);
+    write_block(out, &written, h.priority, tasks.priority, sizeof(uint8_t) * h.tasks);
+    write_block(out, &written, h.burst, tasks.burst, sizeof(int32_t) * h.tasks);
+    write_block(out, &written, h.arrival, tasks.arrival, sizeof(int32_t) * h.tasks);
+
+    free(offsets);
+    if (fflush(out) != 0 || ferror(out)) {
+        perror("write");
+        exit(1);
+    }
+}
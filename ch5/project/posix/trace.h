@@ -0,0 +1,71 @@
+/**
+ * Loading schedule files.
+ *
+ * Both loaders call add() once for every line of the form
+ *
+ *  [name], [priority], [CPU burst]
+ *  [name], [priority], [CPU burst], [arrival time]
+ *
+ * with the name interned (see intern.h). Without an arrival time a
+ * task arrives at time 0. Blank lines are skipped; a
+ * malformed line is reported and ends the program.
+ *
+ * A schedule can also be stored as a binary trace: a header, a string
+ * table of names and one block per column of the task table, each block
+ * starting at a multiple of TRACE_ALIGN bytes. Numbers are stored in the
+ * byte order of the machine that wrote the trace. trace_load recognizes
+ * one by its magic number together with the binary version and byte
+ * order mark after it, so a text schedule whose first name starts with
+ * the magic is still text. A trace is used where it is mapped: nothing
+ * is parsed or copied, but every row is checked as a text line would
+ * be, so a corrupt trace is rejected rather than simulated.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC "SCHEDTRC"
+#define TRACE_VERSION 1
+#define TRACE_BYTE_ORDER 0x01020304
+#define TRACE_ALIGN 64
+
+struct trace_header {
+    char magic[8];              // TRACE_MAGIC, without its NUL
+    uint32_t version;           // TRACE_VERSION
+    uint32_t byte_order;        // TRACE_BYTE_ORDER, as the writer stored it
+    uint64_t tasks;             // entries in every column
+    uint64_t names;             // entries in the string table
+    uint64_t string_bytes;      // size of the string table
+
+    // where each block starts, from the start of the file
+    uint64_t offsets;           // uint32_t per name: where it starts in the strings
+    uint64_t strings;           // the names, each ending with a NUL
+    uint64_t name;              // int32_t per task: its name's number
+    uint64_t priority;          // uint8_t per task
+    uint64_t burst;             // int32_t per task
+    uint64_t arrival;           // int32_t per task
+};
+
+// map the whole file; a binary trace is used in place, and a text
+// schedule is parsed in place
+void trace_load(const char *path);
+
+// read the file in blocks, adding tasks as each block arrives, until
+// end of file; works on pipes as well as files, but only for text
+// schedules
+void trace_stream(int fd);
+
+// the same a block at a time, so that a simulation can run while the
+// file is read (see more_tasks in schedulers.h): trace_stream_more adds
+// the tasks of the next block and returns 0 once the file is done. The
+// tasks must then be in arrival order.
+void trace_stream_open(int fd);
+int trace_stream_more(void);
+
+// write every task in the table as a binary trace
+void trace_save(FILE *out);
+
+#endif
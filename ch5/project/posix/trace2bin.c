@@ -0,0 +1,46 @@
+/**
+ * trace2bin.c
+ *
+ * Converts a schedule file into a binary trace (see trace.h), which the
+ * schedulers map and use in place instead of parsing.
+ *
+ * Usage:
+ *
+ *  ./trace2bin [schedule] trace
+ *
+ * With no schedule, or "-", the schedule is read from standard input.
+ * The schedule is checked the same way the schedulers check it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "task.h"
+#include "trace.h"
+
+int main(int argc, char *argv[])
+{
+    FILE *out;
+
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s [schedule] trace\n", argv[0]);
+        return 1;
+    }
+
+    if (argc == 2 || strcmp(argv[1], "-") == 0)
+        trace_stream(STDIN_FILENO);
+    else
+        trace_load(argv[1]);
+
+    if ((out = fopen(argv[argc - 1], "wb")) == NULL) {
+        perror(argv[argc - 1]);
+        return 1;
+    }
+    trace_save(out);
+    fclose(out);
+
+    free_tasks();
+
+    return 0;
+}
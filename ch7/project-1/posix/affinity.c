@@ -0,0 +1,177 @@
+/**
+ * CPU and NUMA node placement for thread pool workers.
+ *
+ * The topology is read from /sys/devices/system/node, so no NUMA
+ * library is needed. On machines without that directory every CPU is
+ * treated as being on node 0.
+ */
+
+// for the CPU_* macros and pthread_setaffinity_np
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "affinity.h"
+#include "threadpool.h"
+
+#define MAX_NODES 64
+
+static int node_of[CPU_SETSIZE];
+static int nr_nodes;
+static int initialized;
+
+// parse a sysfs cpu list such as "0-3,8-11" and mark those
+// CPUs as belonging to node
+static void read_cpulist(FILE *in, int node)
+{
+    int first, last, c;
+
+    while (fscanf(in, "%d", &first) == 1) {
+        last = first;
+        c = fgetc(in);
+        if (c == '-') {
+            if (fscanf(in, "%d", &last) != 1)
+                return;
+            c = fgetc(in);
+        }
+        for (; first <= last && first < CPU_SETSIZE; first++)
+            node_of[first] = node;
+        if (c != ',')
+            return;
+    }
+}
+
+static void discover(void)
+{
+    char path[64];
+    FILE *in;
+    int node;
+
+    if (initialized)
+        return;
+    initialized = 1;
+
+    nr_nodes = 1;
+    for (node = 0; node < MAX_NODES; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if ((in = fopen(path, "r")) == NULL)
+            continue;
+        read_cpulist(in, node);
+        fclose(in);
+        if (node + 1 > nr_nodes)
+            nr_nodes = node + 1;
+    }
+}
+
+int affinity_node_of(int cpu)
+{
+    discover();
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return 0;
+    return node_of[cpu];
+}
+
+int affinity_nodes(void)
+{
+    discover();
+
+    return nr_nodes;
+}
+
+int affinity_plan(int policy, const int *cpus, int ncpus,
+                  int n, int *cpu, int *node)
+{
+    int allowed[CPU_SETSIZE];
+    int nallowed = 0;
+    int next[MAX_NODES] = { 0 };
+    cpu_set_t set;
+    int i, j, k;
+
+    discover();
+
+    for (i = 0; i < n; i++) {
+        cpu[i] = -1;
+        node[i] = 0;
+    }
+
+    switch (policy) {
+    case POOL_AFFINITY_NONE:
+        return 0;
+
+    case POOL_AFFINITY_LIST:
+        if (cpus == NULL || ncpus <= 0)
+            return 1;
+        for (i = 0; i < n; i++) {
+            cpu[i] = cpus[i % ncpus];
+            node[i] = affinity_node_of(cpu[i]);
+        }
+        return 0;
+
+    case POOL_AFFINITY_COMPACT:
+    case POOL_AFFINITY_SCATTER:
+        break;
+
+    default:
+        return 1;
+    }
+
+    // the CPUs we may run on, grouped by node
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return 1;
+    for (j = 0; j < nr_nodes; j++) {
+        for (i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &set) && node_of[i] == j)
+                allowed[nallowed++] = i;
+        }
+    }
+    if (nallowed == 0)
+        return 1;
+
+    if (policy == POOL_AFFINITY_COMPACT) {
+        // fill one node before moving to the next
+        for (i = 0; i < n; i++) {
+            cpu[i] = allowed[i % nallowed];
+            node[i] = node_of[cpu[i]];
+        }
+        return 0;
+    }
+
+    // scatter: deal workers out to the nodes in turn
+    for (i = 0; i < n; ) {
+        for (j = 0; j < nr_nodes && i < n; j++) {
+            int count = 0, first = -1;
+
+            for (k = 0; k < nallowed; k++) {
+                if (node_of[allowed[k]] == j) {
+                    if (first < 0)
+                        first = k;
+                    count++;
+                }
+            }
+            if (count == 0)
+                continue;
+
+            cpu[i] = allowed[first + next[j]++ % count];
+            node[i] = j;
+            i++;
+        }
+    }
+
+    return 0;
+}
+
+int affinity_pin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return 1;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0;
+}
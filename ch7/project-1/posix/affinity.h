@@ -0,0 +1,25 @@
+/**
+ * CPU and NUMA node placement for thread pool workers.
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+// the NUMA node a CPU belongs to, 0 if unknown
+int affinity_node_of(int cpu);
+
+// number of NUMA nodes found
+int affinity_nodes(void);
+
+// choose a CPU and node for each of n workers under the given policy.
+// cpus/ncpus is the explicit list for POOL_AFFINITY_LIST.
+// workers that should not be pinned get cpu -1.
+// returns 0 if successful or 1 if the policy cannot be satisfied.
+int affinity_plan(int policy, const int *cpus, int ncpus,
+                  int n, int *cpu, int *node);
+
+// pin the calling thread to a CPU
+// returns 0 if successful or 1 otherwise
+int affinity_pin(int cpu);
+
+#endif
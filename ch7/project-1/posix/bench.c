@@ -0,0 +1,157 @@
+/**
+ * Throughput benchmark for the thread pool.
+ *
+ * Measures how many tasks per second the pool moves as the number
+ * of submitting threads grows. With a fan-out, every submitted task
+ * submits that many child tasks from inside the pool, which is where
+ * work-stealing mode pays off. With a batch size, submitters queue
+ * their tasks that many at a time through pool_submit_batch.
+ *
+ * usage: ./bench [tasks] [max submitters] [mode] [fan-out] [batch] [affinity] [stats]
+ *
+ * mode is shared or steal, optionally followed by +dynamic.
+ * affinity is none, compact or scatter. For work-stealing runs the
+ * steal columns show how much work moved between workers on the same
+ * NUMA node and how much had to cross sockets. Passing "stats" turns on
+ * pool statistics, to measure their overhead, and prints them per run.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "threadpool.h"
+
+#define DEFAULT_TASKS 1000000
+#define DEFAULT_SUBMITTERS 8
+#define MAX_BATCH 1024
+
+static atomic_long completed;
+static long tasks_per_submitter;
+static int fan_out;
+static int batch = 1;
+
+// the smallest possible unit of work
+void count(void *param)
+{
+    atomic_fetch_add_explicit(&completed, 1, memory_order_relaxed);
+}
+
+// submit fan_out children from inside the pool.
+// a worker must not wait for queue space that only workers can free,
+// so children that do not fit are run by the submitting worker.
+void spawn(void *param)
+{
+    int i;
+
+    for (i = 0; i < fan_out; i++) {
+        if (pool_submit(&count, NULL) != 0)
+            count(NULL);
+    }
+    count(param);
+}
+
+void *submitter(void *param)
+{
+    void (*work)(void *) = fan_out > 0 ? &spawn : &count;
+    void *params[MAX_BATCH] = { NULL };
+    long i;
+
+    for (i = 0; i + batch <= tasks_per_submitter; i += batch) {
+        // the queue is bounded, so back off while it is full
+        while (pool_submit_batch(work, params, batch) != 0)
+            sched_yield();
+    }
+    for (; i < tasks_per_submitter; i++) {
+        while (pool_submit(work, NULL) != 0)
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_submitters = DEFAULT_SUBMITTERS;
+    int mode = POOL_SHARED_QUEUE;
+    int affinity = POOL_AFFINITY_NONE;
+    long same_node, cross_node;
+    long refills, remote_batches;
+    int show_stats = 0;
+    struct pool_stats stats;
+    int n, i;
+
+    tasks_per_submitter = DEFAULT_TASKS;
+    if (argc > 1)
+        tasks_per_submitter = atol(argv[1]);
+    if (argc > 2)
+        max_submitters = atoi(argv[2]);
+    if (argc > 3 && strncmp(argv[3], "steal", 5) == 0)
+        mode = POOL_WORK_STEALING;
+    if (argc > 3 && strstr(argv[3], "+dynamic") != NULL)
+        mode |= POOL_DYNAMIC;
+    if (argc > 4)
+        fan_out = atoi(argv[4]);
+    if (argc > 5)
+        batch = atoi(argv[5]);
+    if (batch < 1 || batch > MAX_BATCH) {
+        fprintf(stderr, "batch must be between 1 and %d\n", MAX_BATCH);
+        return 1;
+    }
+    if (argc > 6 && strcmp(argv[6], "compact") == 0)
+        affinity = POOL_AFFINITY_COMPACT;
+    if (argc > 6 && strcmp(argv[6], "scatter") == 0)
+        affinity = POOL_AFFINITY_SCATTER;
+    pool_set_affinity(affinity, NULL, 0);
+    if (argc > 7 && strcmp(argv[7], "stats") == 0)
+        show_stats = 1;
+
+    printf("%-12s %-12s %-12s %-12s %-12s %s\n", "submitters", "tasks", "seconds",
+           "tasks/sec", "same-node", "cross-node");
+
+    for (n = 1; n <= max_submitters; n *= 2) {
+        pthread_t *threads = malloc(sizeof(pthread_t) * n);
+        long total = tasks_per_submitter * n * (fan_out + 1);
+        double start, elapsed;
+
+        atomic_store(&completed, 0);
+        pool_init_mode(mode);
+        pool_stats_enable(show_stats);
+
+        start = now();
+        for (i = 0; i < n; i++)
+            pthread_create(&threads[i], NULL, submitter, NULL);
+        for (i = 0; i < n; i++)
+            pthread_join(threads[i], NULL);
+        pool_shutdown();
+        elapsed = now() - start;
+        pool_stats(&stats);
+
+        if (atomic_load(&completed) != total)
+            fprintf(stderr, "lost tasks: ran %ld of %ld\n", atomic_load(&completed), total);
+
+        pool_steal_counts(&same_node, &cross_node);
+        printf("%-12d %-12ld %-12.3f %-12.0f %-12ld %ld\n", n, total, elapsed,
+               total / elapsed, same_node, cross_node);
+        if (show_stats)
+            pool_stats_print(stdout, &stats);
+        free(threads);
+    }
+
+    pool_alloc_counters(&refills, &remote_batches);
+    printf("task record slab refills: %ld, remote free batches: %ld\n",
+           refills, remote_batches);
+
+    return 0;
+}
@@ -20,6 +20,32 @@ void add(void *param)
     printf("I add two values %d and %d result = %d\n",temp->a, temp->b, temp->a + temp->b);
 }
 
+void *multiply(void *param)
+{
+    struct data *temp;
+    temp = (struct data*)param;
+
+    temp->a = temp->a * temp->b;
+
+    return temp;
+}
+
+void double_a(void *param)
+{
+    struct data *temp;
+    temp = (struct data*)param;
+
+    temp->a = temp->a * 2;
+}
+
+void double_b(void *param)
+{
+    struct data *temp;
+    temp = (struct data*)param;
+
+    temp->b = temp->b * 2;
+}
+
 int main(void)
 {
     // create some work to do
@@ -33,8 +59,37 @@ int main(void)
     // submit the work to the queue
     pool_submit(&add,&work);
 
-    // may be helpful 
-    //sleep(3);
+    // submit work whose result we want to wait for
+    struct data product;
+    product.a = 6;
+    product.b = 7;
+
+    struct pool_future *future = pool_submit_future(&multiply,&product);
+    if (future != NULL) {
+        struct data *result = pool_future_result(future);
+        printf("I multiplied two values, result = %d\n", result->a);
+        pool_future_destroy(future);
+    }
+
+    // run a small pipeline: double both values, then add them
+    struct data pipeline;
+    pipeline.a = 1;
+    pipeline.b = 2;
+
+    struct pool_graph *graph = pool_graph_create();
+    if (graph != NULL) {
+        struct pool_node *first = pool_graph_node(graph, &double_a, &pipeline);
+        struct pool_node *second = pool_graph_node(graph, &double_b, &pipeline);
+        struct pool_node *last = pool_graph_node(graph, &add, &pipeline);
+
+        if (first != NULL && second != NULL && last != NULL
+                && pool_graph_then(first, last) == 0
+                && pool_graph_then(second, last) == 0) {
+            pool_graph_run(graph);
+            pool_graph_wait(graph);
+        }
+        pool_graph_destroy(graph);
+    }
 
     pool_shutdown();
 
@@ -0,0 +1,133 @@
+/**
+ * Latency benchmark for the pool's priority lanes.
+ *
+ * A submitter keeps the pool saturated with low priority background
+ * tasks and mixes in a small share of probe tasks. Each probe records
+ * how long it waited before a worker started it. The run is repeated
+ * with the probes in each lane; with the probes in the low lane they
+ * queue behind the whole backlog, in the high or deadline lane they
+ * should only wait for the tasks already running.
+ *
+ * usage: ./latency [tasks] [probe percent] [mode]
+ *
+ * mode is shared or steal.
+ */
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "threadpool.h"
+#include "stats.h"
+
+#define DEFAULT_TASKS 200000
+#define DEFAULT_PERCENT 1
+#define WORK_NS 20000
+
+static long *waited;
+static long *submitted_at;
+
+// spin for a fixed time, standing in for a real request
+void background(void *param)
+{
+    long until = stats_now() + WORK_NS;
+
+    while (stats_now() < until)
+        ;
+}
+
+// note how long this probe sat in the queue
+void probe(void *param)
+{
+    long i = (long) param;
+
+    waited[i] = stats_now() - submitted_at[i];
+    background(NULL);
+}
+
+static int compare(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+// submit one probe to the given lane, or to the deadline lane if lane
+// is POOL_PRIORITIES
+static int submit_probe(int lane, long i)
+{
+    struct timespec deadline;
+
+    submitted_at[i] = stats_now();
+    if (lane < POOL_PRIORITIES)
+        return pool_submit_prio(&probe, (void *) i, lane);
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += WORK_NS;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return pool_submit_deadline(&probe, (void *) i, &deadline);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *names[] = { "high", "normal", "low", "deadline" };
+    long tasks = DEFAULT_TASKS;
+    int percent = DEFAULT_PERCENT;
+    int mode = POOL_SHARED_QUEUE;
+    long probes, i, p;
+    int lane;
+
+    if (argc > 1)
+        tasks = atol(argv[1]);
+    if (argc > 2)
+        percent = atoi(argv[2]);
+    if (argc > 3 && strcmp(argv[3], "steal") == 0)
+        mode = POOL_WORK_STEALING;
+    if (percent < 1 || percent > 100) {
+        fprintf(stderr, "probe percent must be between 1 and 100\n");
+        return 1;
+    }
+
+    probes = tasks * percent / 100;
+    if (probes < 1) {
+        fprintf(stderr, "too few tasks for even one probe\n");
+        return 1;
+    }
+    waited = malloc(sizeof(long) * (probes + 1));
+    submitted_at = malloc(sizeof(long) * (probes + 1));
+
+    printf("%-12s %-12s %-12s %-12s %s\n", "probe lane", "probes",
+           "p50 (us)", "p99 (us)", "max (us)");
+
+    for (lane = 0; lane <= POOL_PRIORITIES; lane++) {
+        pool_init_mode(mode);
+
+        for (i = 0, p = 0; i < tasks; i++) {
+            // one probe in every 100 / percent tasks
+            if (p < probes && i * percent / 100 >= p) {
+                while (submit_probe(lane, p) != 0)
+                    sched_yield();
+                p++;
+                continue;
+            }
+            // the lanes are bounded, so back off while they are full
+            while (pool_submit_prio(&background, NULL, POOL_PRIO_LOW) != 0)
+                sched_yield();
+        }
+        pool_shutdown();
+
+        qsort(waited, p, sizeof(long), compare);
+        printf("%-12s %-12ld %-12.1f %-12.1f %.1f\n", names[lane], p,
+               waited[p / 2] / 1e3, waited[p * 99 / 100] / 1e3, waited[p - 1] / 1e3);
+    }
+
+    free(waited);
+    free(submitted_at);
+
+    return 0;
+}
@@ -0,0 +1,219 @@
+/**
+ * Per-thread slab allocator for small fixed-size records.
+ *
+ * Every thread allocates from its own cache, so in steady state an
+ * allocation or a free by the owning thread is a couple of pointer
+ * moves. An object freed by another thread is queued in that thread's
+ * batch and the whole batch is pushed onto the owner's remote list with
+ * a single compare-and-swap; the owner takes the remote list with one
+ * exchange when its local free list runs out, and only carves a fresh
+ * chunk from the heap when both are empty.
+ *
+ * Caches are never destroyed. When a thread exits, its cache is parked
+ * on an orphan list and adopted by the next new thread, so objects freed
+ * after their owner has gone still have somewhere to go.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "slab.h"
+
+#define CACHE_LINE 64
+
+struct slab_cache;
+
+// an object: a header naming the owning cache, then the payload
+struct slab_obj
+{
+    struct slab_cache *owner;
+    struct slab_obj *next;      // only while free
+    _Alignas(16) char payload[SLAB_OBJECT_SIZE];
+};
+
+struct slab_cache
+{
+    // touched by the owner only
+    struct slab_obj *free_list;
+
+    // pushed by other threads, taken by the owner
+    _Alignas(CACHE_LINE) _Atomic(struct slab_obj *) remote;
+
+    atomic_long refills;
+    struct slab_cache *next_cache;  // all caches, for the counters
+    struct slab_cache *next_orphan;
+};
+
+// remote frees waiting to go back to one owner
+struct remote_batch
+{
+    struct slab_cache *owner;
+    struct slab_obj *head;
+    struct slab_obj *tail;
+    int count;
+};
+
+static _Thread_local struct slab_cache *cache;
+static _Thread_local struct remote_batch batch;
+
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct slab_cache *all_caches;
+static struct slab_cache *orphans;
+static atomic_long remote_batches;
+
+static pthread_key_t exit_key;
+static pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+
+// give the exiting thread's cache to whoever starts next
+static void orphan_cache(void *param)
+{
+    struct slab_cache *c = param;
+
+    slab_flush();
+
+    pthread_mutex_lock(&caches_lock);
+    c->next_orphan = orphans;
+    orphans = c;
+    pthread_mutex_unlock(&caches_lock);
+}
+
+static void make_exit_key(void)
+{
+    pthread_key_create(&exit_key, orphan_cache);
+}
+
+// the calling thread's cache, adopting or creating one on first use
+static struct slab_cache *my_cache(void)
+{
+    struct slab_cache *c = cache;
+
+    if (c != NULL)
+        return c;
+
+    pthread_once(&exit_key_once, make_exit_key);
+
+    pthread_mutex_lock(&caches_lock);
+    if ((c = orphans) != NULL) {
+        orphans = c->next_orphan;
+    }
+    else if ((c = aligned_alloc(CACHE_LINE, sizeof(struct slab_cache))) != NULL) {
+        c->free_list = NULL;
+        atomic_init(&c->remote, NULL);
+        atomic_init(&c->refills, 0);
+        c->next_cache = all_caches;
+        all_caches = c;
+    }
+    pthread_mutex_unlock(&caches_lock);
+
+    if (c == NULL) {
+        fprintf(stderr, "slab: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    cache = c;
+    pthread_setspecific(exit_key, c);
+
+    return c;
+}
+
+// carve a new chunk of objects onto the local free list
+static void refill(struct slab_cache *c)
+{
+    struct slab_obj *chunk = aligned_alloc(CACHE_LINE, sizeof(struct slab_obj) * SLAB_CHUNK);
+    int i;
+
+    if (chunk == NULL) {
+        fprintf(stderr, "slab: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < SLAB_CHUNK; i++) {
+        chunk[i].owner = c;
+        chunk[i].next = c->free_list;
+        c->free_list = &chunk[i];
+    }
+    atomic_fetch_add_explicit(&c->refills, 1, memory_order_relaxed);
+}
+
+void *slab_alloc(void)
+{
+    struct slab_cache *c = my_cache();
+    struct slab_obj *o = c->free_list;
+
+    if (o == NULL) {
+        // take back everything other threads have freed
+        o = atomic_exchange_explicit(&c->remote, NULL, memory_order_acquire);
+        if (o == NULL) {
+            refill(c);
+            o = c->free_list;
+        }
+    }
+
+    c->free_list = o->next;
+
+    return o->payload;
+}
+
+void slab_flush(void)
+{
+    struct slab_cache *owner = batch.owner;
+    struct slab_obj *head;
+
+    if (batch.count == 0)
+        return;
+
+    head = atomic_load_explicit(&owner->remote, memory_order_relaxed);
+    do {
+        batch.tail->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote, &head, batch.head,
+                memory_order_release, memory_order_relaxed));
+
+    atomic_fetch_add_explicit(&remote_batches, 1, memory_order_relaxed);
+    batch.owner = NULL;
+    batch.head = batch.tail = NULL;
+    batch.count = 0;
+}
+
+void slab_free(void *p)
+{
+    struct slab_obj *o;
+
+    if (p == NULL)
+        return;
+
+    o = (struct slab_obj *)((char *)p - offsetof(struct slab_obj, payload));
+
+    if (o->owner == cache) {
+        o->next = cache->free_list;
+        cache->free_list = o;
+        return;
+    }
+
+    // batches go to a single owner
+    if (batch.owner != o->owner)
+        slab_flush();
+
+    o->next = batch.head;
+    batch.head = o;
+    if (batch.tail == NULL)
+        batch.tail = o;
+    batch.owner = o->owner;
+
+    if (++batch.count == SLAB_BATCH)
+        slab_flush();
+}
+
+void slab_counters(long *refills, long *batches)
+{
+    struct slab_cache *c;
+
+    *refills = 0;
+    pthread_mutex_lock(&caches_lock);
+    for (c = all_caches; c != NULL; c = c->next_cache)
+        *refills += atomic_load_explicit(&c->refills, memory_order_relaxed);
+    pthread_mutex_unlock(&caches_lock);
+
+    *batches = atomic_load_explicit(&remote_batches, memory_order_relaxed);
+}
@@ -0,0 +1,30 @@
+/**
+ * Per-thread slab allocator for small fixed-size records.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+// usable bytes in every object; with its header an object is one cache line
+#define SLAB_OBJECT_SIZE 48
+
+// objects carved from the heap at a time when a thread runs dry
+#define SLAB_CHUNK 256
+
+// remote frees held back before they are handed to their owner
+#define SLAB_BATCH 32
+
+// allocate an object, from the calling thread's own slab
+void *slab_alloc(void);
+
+// free an object allocated by any thread
+void slab_free(void *p);
+
+// hand any batched remote frees back to their owners now
+void slab_flush(void);
+
+// number of times a thread had to carve a new chunk, and number of
+// batches of remote frees returned to their owners
+void slab_counters(long *refills, long *remote_batches);
+
+#endif
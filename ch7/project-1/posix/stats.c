@@ -0,0 +1,103 @@
+/**
+ * Latency histograms for thread pool statistics.
+ */
+
+#include <time.h>
+#include "stats.h"
+
+#define SUB_COUNT (1 << HIST_SUB_BITS)
+
+static int bucket_of(long value)
+{
+    int msb;
+
+    if (value < SUB_COUNT)
+        return value < 0 ? 0 : (int)value;
+
+    msb = 63 - __builtin_clzl((unsigned long)value);
+
+    return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+        + (int)((value >> (msb - HIST_SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+// the largest value that lands in a bucket
+static long bucket_top(int bucket)
+{
+    int msb;
+
+    if (bucket < SUB_COUNT)
+        return bucket;
+
+    msb = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+
+    return (1L << msb)
+        + ((long)((bucket & (SUB_COUNT - 1)) + 1) << (msb - HIST_SUB_BITS)) - 1;
+}
+
+void hist_reset(struct histogram *h)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        atomic_store_explicit(&h->count[i], 0, memory_order_relaxed);
+}
+
+void hist_record(struct histogram *h, long value)
+{
+    atomic_long *c = &h->count[bucket_of(value)];
+
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+void hist_merge(long *into, const struct histogram *h)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        into[i] += atomic_load_explicit(&h->count[i], memory_order_relaxed);
+}
+
+long hist_percentile(const long *counts, double fraction)
+{
+    long total = 0, seen = 0, rank;
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        total += counts[i];
+    if (total == 0)
+        return 0;
+
+    rank = (long)(fraction * total);
+    if (rank >= total)
+        rank = total - 1;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > rank)
+            return bucket_top(i);
+    }
+
+    return 0;
+}
+
+long hist_max(const long *counts)
+{
+    int i;
+
+    for (i = HIST_BUCKETS - 1; i >= 0; i--) {
+        if (counts[i] != 0)
+            return bucket_top(i);
+    }
+
+    return 0;
+}
+
+long stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
@@ -0,0 +1,41 @@
+/**
+ * Latency histograms for thread pool statistics.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+
+// each power of two is split into 1 << HIST_SUB_BITS buckets,
+// which keeps every recorded value within 12.5% of its true size
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+// a log-linear (HDR style) histogram of nanosecond values.
+// written by one thread, read by any, so counts are only ever loaded
+// and stored, never read-modify-written.
+struct histogram
+{
+    atomic_long count[HIST_BUCKETS];
+};
+
+// clear a histogram
+void hist_reset(struct histogram *h);
+
+// add one value; only the owning thread may call this
+void hist_record(struct histogram *h, long value);
+
+// add a histogram's counts into a plain array of HIST_BUCKETS
+void hist_merge(long *into, const struct histogram *h);
+
+// the value below which the given fraction of merged counts fall
+long hist_percentile(const long *counts, double fraction);
+
+// the largest value in merged counts
+long hist_max(const long *counts);
+
+// monotonic time in nanoseconds
+long stats_now(void);
+
+#endif
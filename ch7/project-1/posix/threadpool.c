@@ -1,55 +1,955 @@
 /**
  * Implementation of thread pool.
+ *
+ * The work queue is a bounded multi-producer/multi-consumer ring buffer.
+ * Every slot carries a sequence number that tells producers and consumers
+ * whose turn it is to use the slot, so submitters and workers only ever
+ * race on the head/tail counters and never take a lock.
+ *
+ * There is one such ring per priority lane. Workers serve the lanes in a
+ * smooth weighted round-robin (LANE_WEIGHTS), falling through to the next
+ * lane when one is empty, so a busy high lane cannot starve the others:
+ * every non-empty lane is served at least once per cycle of the weights.
+ * Tasks with a deadline go to a separate earliest-deadline-first heap,
+ * which is served whenever the high lane's turn comes up.
+ *
+ * In work-stealing mode each worker also owns a Chase-Lev deque. Tasks
+ * submitted from inside a running task go onto the submitting worker's
+ * deque, where the owner pops them LIFO from the bottom without any
+ * atomic read-modify-write, and idle workers steal FIFO from the top of
+ * a random victim. The ring buffer then only carries work submitted from
+ * outside the pool.
+ *
+ * In dynamic mode the pool starts with NUMBER_OF_THREADS workers, adds
+ * workers (up to one per online CPU) while submitters find the queue
+ * backing up with nobody idle, and lets extra workers go once they have
+ * been idle for IDLE_TIMEOUT_MS. An idle worker spins for a short while
+ * before parking on the semaphore, so a burst of work is picked up
+ * without a wakeup, while a quiet pool uses no CPU at all.
+ *
+ * Workers can be pinned to CPUs (see pool_set_affinity). A pinned
+ * worker allocates its own deque after pinning, so the memory comes
+ * from its NUMA node, and steals from workers on the same node before
+ * it crosses to another socket.
+ *
+ * The pool can be shut down three ways: draining runs everything that
+ * was queued, stopping now lets running tasks finish but hands queued
+ * tasks back to the caller unrun, and a deadline drains until the
+ * deadline passes and then stops. Futures and graphs whose tasks are
+ * discarded are cancelled instead, which wakes anybody waiting on them,
+ * even a running task. Like a Java thread's interrupt status,
+ * pool_cancelled() lets long-running tasks notice a stop and return
+ * early.
+ *
+ * Tasks that sit on a deque need a record of their own. Those come from
+ * a per-worker slab (see slab.c), so submitting and completing them does
+ * not touch malloc once the pool has warmed up.
+ *
+ * Statistics are opt-in (pool_stats_enable). Each worker keeps its own
+ * counters and latency histograms, written with plain loads and stores
+ * on its own cache lines, and pool_stats() adds them up when asked, so
+ * leaving them on costs two clock reads per task.
+ *
+ * Futures wrap a task that produces a result. Completing a future costs
+ * a single compare-and-swap unless somebody is already blocked on it.
+ *
+ * A task graph is a set of tasks with "runs after" edges. Each node
+ * counts the predecessors it is still waiting for; the task that
+ * brings a count to zero picks that node up and runs it inline on the
+ * same worker, while its data is still in cache, and submits any other
+ * successors it made ready. Completion of the whole graph is signalled
+ * through an embedded future, so nothing blocks a worker between steps.
  */
 
+// for pthread_timedjoin_np
+#define _GNU_SOURCE
+
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <semaphore.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
 #include "threadpool.h"
+#include "affinity.h"
+#include "slab.h"
+#include "stats.h"
 
-#define QUEUE_SIZE 10
+// must be a power of two
+#define QUEUE_SIZE 1024
+#define DEQUE_SIZE 4096
 #define NUMBER_OF_THREADS 3
 
+// upper bound on workers in dynamic mode
+#define MAX_THREADS POOL_MAX_WORKERS
+
+// dynamic mode: how long an extra worker may sit idle before exiting
+#define IDLE_TIMEOUT_MS 2000
+
+// dynamic mode: queued tasks per running worker before we add one
+#define GROW_THRESHOLD 4
+
+// polls of the queues before an idle worker parks
+#define SPIN_COUNT 2000
+
+// share of dequeues given to the high, normal and low lanes
+#define LANE_WEIGHTS { 8, 4, 1 }
+#define LANE_CYCLE 13
+
 #define TRUE 1
 
-// this represents work that has to be 
+#define CACHE_LINE 64
+
+_Static_assert((QUEUE_SIZE & (QUEUE_SIZE - 1)) == 0,
+               "QUEUE_SIZE must be a power of two");
+_Static_assert((DEQUE_SIZE & (DEQUE_SIZE - 1)) == 0,
+               "DEQUE_SIZE must be a power of two");
+// this represents work that has to be
 // completed by a thread in the pool
-typedef struct 
+typedef struct
 {
     void (*function)(void *p);
     void *data;
+    long queued;    // when it was submitted, if stats are on
 }
 task;
 
-// the work queue
-task worktodo;
+_Static_assert(sizeof(task) <= SLAB_OBJECT_SIZE,
+               "tasks must fit in a slab object");
+
+// shutdown states
+#define RUNNING 0
+#define SHUTDOWN_DRAIN 1    // run what is queued, then exit
+#define SHUTDOWN_NOW 2      // finish running tasks, leave the rest queued
+#define STOPPED 3           // all workers have exited
+
+// a slot in the work queue.
+// seq == pos     : free, may be filled by the producer claiming pos
+// seq == pos + 1 : full, may be drained by the consumer claiming pos
+struct slot
+{
+    atomic_size_t seq;
+    task t;
+};
+
+// a bounded work queue.
+// producers and consumers each get their own cache line
+struct ring
+{
+    struct slot slots[QUEUE_SIZE];
+    _Alignas(CACHE_LINE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE) atomic_size_t dequeue_pos;
+};
+
+// the work queues, one per priority lane
+static struct ring worktodo[POOL_PRIORITIES];
+
+// the order in which workers visit the lanes, see LANE_WEIGHTS
+static int lane_order[LANE_CYCLE];
+
+// a task waiting in the earliest-deadline-first lane
+struct edf_entry
+{
+    long deadline;
+    task t;
+};
+
+// the earliest-deadline-first lane: a binary min-heap on deadline.
+// edf_count lets workers skip the lock while the lane is empty.
+static pthread_mutex_t edf_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct edf_entry *edf_heap;
+static int edf_size;
+static _Alignas(CACHE_LINE) atomic_int edf_count;
+
+// future states
+#define FUTURE_PENDING 0
+#define FUTURE_WAITING 1    // pending, and a waiter is asleep on done
+#define FUTURE_DONE 2
+#define FUTURE_CANCELLED 3  // its task was discarded by a stop
+
+// the result of a task submitted with pool_submit_future
+struct pool_future
+{
+    void *(*function)(void *p);
+    void *data;
+    void *result;
+    atomic_int state;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+};
+
+// a task in a graph. deps counts unfinished predecessors, plus one
+// until the graph is run, so that no node starts while edges are added.
+struct pool_node
+{
+    void (*function)(void *p);
+    void *data;
+    atomic_int deps;
+    struct pool_node **succ;
+    int nsucc;
+    int succ_size;
+    struct pool_graph *graph;
+    struct pool_node *next;
+};
+
+// a set of nodes that completes as a whole
+struct pool_graph
+{
+    struct pool_node *nodes;
+    int count;
+    atomic_int remaining;
+    atomic_int cancelled;   // a node was discarded by a stop
+    struct pool_future done;
+};
+
+// a worker's private deque of slab-allocated tasks.
+// the owner pushes and takes at bottom, thieves steal at top.
+// buf is allocated by the owning worker, on its own NUMA node.
+struct deque
+{
+    _Alignas(CACHE_LINE) atomic_long top;
+    _Alignas(CACHE_LINE) atomic_long bottom;
+    _Atomic(task *) *buf;
+};
+
+// bee states
+#define BEE_UNUSED 0
+#define BEE_RUNNING 1
+#define BEE_EXITED 2    // finished, waiting to be joined
+
+// a worker bee and the state it owns
+struct bee
+{
+    pthread_t thread;
+    int state;
+    int cpu;            // -1 if not pinned
+    int node;
+    unsigned int seed;
+    int lane_turn;      // position in lane_order
+    atomic_long steals_same_node;
+    atomic_long steals_cross_node;
+    struct deque dq;
+
+    // statistics, written only by this worker
+    _Alignas(CACHE_LINE) atomic_long tasks;
+    atomic_long parks;
+    struct histogram wait;
+    struct histogram run;
+};
+
+// idle workers sleep on the semaphore; idle_workers counts the
+// sleepers that have not yet been handed a wakeup
+static _Alignas(CACHE_LINE) atomic_int idle_workers;
+static sem_t wakeup;
+
+// RUNNING, SHUTDOWN_DRAIN, SHUTDOWN_NOW or STOPPED
+static atomic_int shutting_down;
+
+// submitters from outside the pool that are between checking for
+// STOPPED and queueing their task
+static atomic_int submitters;
+
+// POOL_SHARED_QUEUE or POOL_WORK_STEALING, optionally with
+// POOL_DYNAMIC, fixed at pool_init time
+static int pool_mode;
+
+// the worker bees.
+// slots [0, nr_slots) have been used at some point; running_bees and
+// max_bees bound how many may run at once. slot states only change
+// with resize_lock held.
+static struct bee bees[MAX_THREADS];
+static atomic_int nr_slots;
+static atomic_int running_bees;
+static int max_bees;
+static pthread_mutex_t resize_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the bee running on this thread, NULL outside the pool
+static _Thread_local struct bee *self;
 
-// the worker bee
-pthread_t bee;
+// opt-in statistics, see pool_stats_enable
+static atomic_int stats_enabled;
+static _Alignas(CACHE_LINE) atomic_long queue_high_water;
+
+// periodic statistics dump, see pool_stats_dump_every
+static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dump_stop = PTHREAD_COND_INITIALIZER;
+static pthread_t dump_thread;
+static int dump_running;
+static int dump_interval_ms;
+static void (*dump_hook)(const struct pool_stats *s);
+
+// worker placement, see pool_set_affinity
+static int affinity_policy = POOL_AFFINITY_NONE;
+static int *affinity_cpus;
+static int affinity_ncpus;
 
 // insert a task into the queue
-// returns 0 if successful or 1 otherwise, 
-int enqueue(task t) 
+// returns 0 if successful or 1 otherwise,
+int enqueue(struct ring *q, task t)
 {
-    return 0;
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        struct slot *s = &q->slots[pos & (QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+
+        if (diff == 0) {
+            // slot is free, try to claim it
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed)) {
+                s->t = t;
+                atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        }
+        else if (diff < 0) {
+            // the queue is full
+            return 1;
+        }
+        else {
+            // another producer got here first
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
 }
 
 // remove a task from the queue
-task dequeue() 
+// returns 0 if successful or 1 if the queue is empty
+int dequeue(struct ring *q, task *t)
+{
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+    for (;;) {
+        struct slot *s = &q->slots[pos & (QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+
+        if (diff == 0) {
+            // slot is full, try to claim it
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed)) {
+                *t = s->t;
+                // hand the slot to the producer one lap ahead
+                atomic_store_explicit(&s->seq, pos + QUEUE_SIZE, memory_order_release);
+                return 0;
+            }
+        }
+        else if (diff < 0) {
+            // the queue is empty
+            return 1;
+        }
+        else {
+            // another consumer got here first
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// insert n tasks running somefunction on each of params[]
+// all slots are claimed with one compare-and-swap on the tail
+// returns 0 if successful or 1 if the queue cannot take all of them
+static int enqueue_batch(struct ring *q, void (*somefunction)(void *p),
+                         void *params[], int n, long queued)
+{
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    ptrdiff_t diff = 0;
+    int i;
+
+    if (n > QUEUE_SIZE)
+        return 1;
+
+    for (;;) {
+        // every slot we want must be free for this lap
+        for (i = 0; i < n; i++) {
+            struct slot *s = &q->slots[(pos + i) & (QUEUE_SIZE - 1)];
+            size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+
+            diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + i);
+            if (diff != 0)
+                break;
+        }
+
+        if (i == n) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + n,
+                        memory_order_relaxed, memory_order_relaxed)) {
+                for (i = 0; i < n; i++) {
+                    struct slot *s = &q->slots[(pos + i) & (QUEUE_SIZE - 1)];
+
+                    s->t.function = somefunction;
+                    s->t.data = params[i];
+                    s->t.queued = queued;
+                    atomic_store_explicit(&s->seq, pos + i + 1, memory_order_release);
+                }
+                return 0;
+            }
+        }
+        else if (diff < 0) {
+            // not enough room
+            return 1;
+        }
+        else {
+            // another producer got here first
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// true if the ring holds a task or a producer is about to publish one
+static int ring_pending(struct ring *q)
+{
+    return atomic_load(&q->enqueue_pos) != atomic_load(&q->dequeue_pos);
+}
+
+// insert a task into the deadline lane
+// returns 0 if successful or 1 if out of memory
+static int edf_insert(long deadline, task t)
+{
+    int i, parent;
+
+    pthread_mutex_lock(&edf_lock);
+
+    i = atomic_load_explicit(&edf_count, memory_order_relaxed);
+    if (i == edf_size) {
+        int size = edf_size ? edf_size * 2 : QUEUE_SIZE;
+        struct edf_entry *grown = realloc(edf_heap, sizeof(struct edf_entry) * size);
+
+        if (grown == NULL) {
+            pthread_mutex_unlock(&edf_lock);
+            return 1;
+        }
+        edf_heap = grown;
+        edf_size = size;
+    }
+
+    // sift up
+    for (; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (edf_heap[parent].deadline <= deadline)
+            break;
+        edf_heap[i] = edf_heap[parent];
+    }
+    edf_heap[i].deadline = deadline;
+    edf_heap[i].t = t;
+    atomic_fetch_add(&edf_count, 1);
+
+    pthread_mutex_unlock(&edf_lock);
+
+    return 0;
+}
+
+// remove the task with the earliest deadline
+// returns 0 if successful or 1 if the lane is empty
+static int edf_take(task *t)
+{
+    struct edf_entry last;
+    int n, i, child;
+
+    if (atomic_load_explicit(&edf_count, memory_order_relaxed) == 0)
+        return 1;
+
+    pthread_mutex_lock(&edf_lock);
+
+    n = atomic_load_explicit(&edf_count, memory_order_relaxed);
+    if (n == 0) {
+        pthread_mutex_unlock(&edf_lock);
+        return 1;
+    }
+
+    *t = edf_heap[0].t;
+    last = edf_heap[--n];
+
+    // sift the last entry down from the root
+    for (i = 0; (child = 2 * i + 1) < n; i = child) {
+        if (child + 1 < n && edf_heap[child + 1].deadline < edf_heap[child].deadline)
+            child++;
+        if (last.deadline <= edf_heap[child].deadline)
+            break;
+        edf_heap[i] = edf_heap[child];
+    }
+    edf_heap[i] = last;
+    atomic_store(&edf_count, n);
+
+    pthread_mutex_unlock(&edf_lock);
+
+    return 0;
+}
+
+// true if there is deadline or high priority work waiting
+static int urgent_pending(void)
+{
+    return atomic_load_explicit(&edf_count, memory_order_relaxed) != 0
+        || ring_pending(&worktodo[POOL_PRIO_HIGH]);
+}
+
+// remove a task from the priority lanes. each call takes the next
+// lane in the weighted order; if that lane is empty the lanes are
+// tried from highest priority down. deadline work rides on the high
+// lane's turns.
+// returns 0 if successful or 1 if every lane is empty
+static int dequeue_lanes(struct bee *me, task *t)
+{
+    int lane = lane_order[me->lane_turn];
+    int i;
+
+    me->lane_turn = (me->lane_turn + 1) % LANE_CYCLE;
+
+    if (lane == POOL_PRIO_HIGH && edf_take(t) == 0)
+        return 0;
+    if (dequeue(&worktodo[lane], t) == 0)
+        return 0;
+
+    if (edf_take(t) == 0)
+        return 0;
+    for (i = 0; i < POOL_PRIORITIES; i++) {
+        if (i != lane && dequeue(&worktodo[i], t) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+// push a task onto the bottom of the owner's deque
+// returns 0 if successful or 1 if the deque is full
+static int deque_push(struct deque *dq, task *t)
+{
+    long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&dq->top, memory_order_acquire);
+
+    if (b - top > DEQUE_SIZE - 1)
+        return 1;
+
+    atomic_store_explicit(&dq->buf[b & (DEQUE_SIZE - 1)], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+
+    return 0;
+}
+
+// push n tasks running somefunction on each of params[], publishing
+// them all with a single store to bottom
+// returns 0 if successful or 1 if the deque cannot take all of them
+static int deque_push_batch(struct deque *dq, void (*somefunction)(void *p),
+                            void *params[], int n, long queued)
+{
+    long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&dq->top, memory_order_acquire);
+    int i;
+
+    if (b - top > DEQUE_SIZE - n)
+        return 1;
+
+    for (i = 0; i < n; i++) {
+        task *t = slab_alloc();
+
+        t->function = somefunction;
+        t->data = params[i];
+        t->queued = queued;
+        atomic_store_explicit(&dq->buf[(b + i) & (DEQUE_SIZE - 1)], t, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&dq->bottom, b + n, memory_order_relaxed);
+
+    return 0;
+}
+
+// take the most recently pushed task, called only by the owner
+// returns NULL if the deque is empty
+static task *deque_take(struct deque *dq)
 {
-    return worktodo;
+    long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+    long top;
+    task *t = NULL;
+
+    atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+    if (top <= b) {
+        t = atomic_load_explicit(&dq->buf[b & (DEQUE_SIZE - 1)], memory_order_relaxed);
+        if (top == b) {
+            // last task, race the thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&dq->top, &top, top + 1,
+                        memory_order_seq_cst, memory_order_relaxed))
+                t = NULL;
+            atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+        }
+    }
+    else {
+        atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return t;
+}
+
+// steal the oldest task from another worker's deque
+// returns NULL if the deque is empty or we lost a race for the task
+static task *deque_steal(struct deque *dq)
+{
+    long top = atomic_load_explicit(&dq->top, memory_order_acquire);
+    long b;
+    task *t;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+    if (top >= b)
+        return NULL;
+
+    t = atomic_load_explicit(&dq->buf[top & (DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&dq->top, &top, top + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+
+    return t;
+}
+
+static int deque_pending(struct deque *dq)
+{
+    return atomic_load(&dq->bottom) > atomic_load(&dq->top);
+}
+
+// true if there may be work in the queue
+static int queue_pending(void)
+{
+    int i;
+
+    for (i = 0; i < POOL_PRIORITIES; i++) {
+        if (ring_pending(&worktodo[i]))
+            return TRUE;
+    }
+    if (atomic_load(&edf_count) != 0)
+        return TRUE;
+
+    if (pool_mode & POOL_WORK_STEALING) {
+        int n = atomic_load(&nr_slots);
+
+        for (i = 0; i < n; i++) {
+            if (deque_pending(&bees[i].dq))
+                return TRUE;
+        }
+    }
+
+    return 0;
+}
+
+// hand a wakeup to one idle worker, if there is one
+static void wake_one(void)
+{
+    int n = atomic_load(&idle_workers);
+
+    while (n > 0) {
+        if (atomic_compare_exchange_weak(&idle_workers, &n, n - 1)) {
+            sem_post(&wakeup);
+            return;
+        }
+    }
+}
+
+// take ourselves off the idle count, unless a submitter has already
+// claimed us, in which case its wakeup is on the way
+// returns 1 if we are no longer idle or 0 if we must take the wakeup
+static int unpark(void)
+{
+    int n = atomic_load(&idle_workers);
+
+    while (n > 0) {
+        if (atomic_compare_exchange_weak(&idle_workers, &n, n - 1))
+            return 1;
+    }
+
+    return 0;
+}
+
+// sleep until there is work to do.
+// a worker announces itself idle before checking the queue one last
+// time, and a submitter publishes its task before looking for idle
+// workers, so at least one of them always sees the other.
+// with a timeout, returns 1 if we went IDLE_TIMEOUT_MS without being
+// woken, otherwise returns 0.
+static int park(int timeout)
+{
+    struct timespec deadline;
+
+    // do not sit on frees other workers are waiting for
+    slab_flush();
+
+    if (self != NULL && atomic_load_explicit(&stats_enabled, memory_order_relaxed))
+        atomic_store_explicit(&self->parks,
+                atomic_load_explicit(&self->parks, memory_order_relaxed) + 1,
+                memory_order_relaxed);
+
+    atomic_fetch_add(&idle_workers, 1);
+
+    if (queue_pending() || atomic_load(&shutting_down)) {
+        if (unpark())
+            return 0;
+    }
+    else if (timeout) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += IDLE_TIMEOUT_MS / 1000;
+        deadline.tv_nsec += (IDLE_TIMEOUT_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        for (;;) {
+            if (sem_timedwait(&wakeup, &deadline) == 0)
+                return 0;
+            if (errno == ETIMEDOUT && unpark())
+                return 1;
+            if (errno == ETIMEDOUT)
+                break;
+        }
+    }
+
+    while (sem_wait(&wakeup) != 0)
+        ;
+
+    return 0;
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+// xorshift, good enough to pick steal victims
+static unsigned int next_random(unsigned int *seed)
+{
+    unsigned int x = *seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+
+    return x;
+}
+
+// try each other worker once, starting from a random victim
+// workers on our own node get the first pass, so that tasks only
+// cross sockets once the node has run dry.
+static task *steal_work(struct bee *me)
+{
+    int n = atomic_load(&nr_slots);
+    int start = next_random(&me->seed) % n;
+    int pass, i;
+    task *t;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < n; i++) {
+            struct bee *victim = &bees[(start + i) % n];
+
+            if (victim == me || (victim->node == me->node) != (pass == 0))
+                continue;
+            if ((t = deque_steal(&victim->dq)) != NULL) {
+                atomic_fetch_add_explicit(pass == 0 ? &me->steals_same_node
+                                                    : &me->steals_cross_node,
+                                          1, memory_order_relaxed);
+                return t;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// find the next task for a work-stealing worker: urgent work first,
+// then our own deque, then the shared lanes, then the other workers'
+// deques
+// returns 0 if successful or 1 if there was nothing to run
+static int find_work(struct bee *me, task *t)
+{
+    task *local;
+
+    if (!(pool_mode & POOL_WORK_STEALING))
+        return dequeue_lanes(me, t);
+
+    if (urgent_pending() && dequeue_lanes(me, t) == 0)
+        return 0;
+
+    if ((local = deque_take(&me->dq)) == NULL
+            && dequeue_lanes(me, t) != 0
+            && (local = steal_work(me)) == NULL)
+        return 1;
+
+    if (local != NULL) {
+        *t = *local;
+        slab_free(local);
+    }
+
+    return 0;
+}
+
+// run a task, timing it if stats are on
+static void run_task(struct bee *me, task *t)
+{
+    long start, end;
+
+    if (!atomic_load_explicit(&stats_enabled, memory_order_relaxed)) {
+        execute(t->function, t->data);
+        return;
+    }
+
+    start = stats_now();
+    execute(t->function, t->data);
+    end = stats_now();
+
+    // tasks queued before stats were switched on have no timestamp
+    if (t->queued != 0)
+        hist_record(&me->wait, start - t->queued);
+    hist_record(&me->run, end - start);
+    atomic_store_explicit(&me->tasks,
+            atomic_load_explicit(&me->tasks, memory_order_relaxed) + 1,
+            memory_order_relaxed);
+}
+
+// poll for work for a little while before giving up the CPU
+// returns 0 if a task was found or 1 otherwise
+static int spin_for_work(struct bee *me, task *t)
+{
+    int i;
+
+    for (i = 0; i < SPIN_COUNT; i++) {
+        if (find_work(me, t) == 0)
+            return 0;
+        if (atomic_load_explicit(&shutting_down, memory_order_relaxed))
+            break;
+        cpu_relax();
+    }
+
+    return 1;
+}
+
+// an idle worker in dynamic mode leaves if the pool is above its
+// minimum size. returns 1 if the worker should exit.
+static int retire(struct bee *me)
+{
+    int leave = 0;
+
+    pthread_mutex_lock(&resize_lock);
+    if (atomic_load(&running_bees) > NUMBER_OF_THREADS && !queue_pending()) {
+        atomic_fetch_sub(&running_bees, 1);
+        me->state = BEE_EXITED;
+        leave = 1;
+    }
+    pthread_mutex_unlock(&resize_lock);
+
+    return leave;
 }
 
 // the worker thread in the thread pool
 void *worker(void *param)
 {
-    // execute the task
-    execute(worktodo.function, worktodo.data);
+    struct bee *me = param;
+    int dynamic = pool_mode & POOL_DYNAMIC;
+    task t;
+
+    self = me;
+
+    // pin first, so that what we allocate next is node-local
+    if (me->cpu >= 0)
+        affinity_pin(me->cpu);
+    if (me->dq.buf == NULL) {
+        me->dq.buf = calloc(DEQUE_SIZE, sizeof(*me->dq.buf));
+        if (me->dq.buf == NULL) {
+            fprintf(stderr, "threadpool: out of memory for worker deque\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    while (TRUE) {
+        if (atomic_load(&shutting_down) == SHUTDOWN_NOW)
+            break;
+
+        if (find_work(me, &t) == 0 || spin_for_work(me, &t) == 0) {
+            // execute the task
+            run_task(me, &t);
+            continue;
+        }
+
+        // drain everything that was submitted before shutdown
+        if (atomic_load(&shutting_down) && !queue_pending())
+            break;
+
+        if (park(dynamic) && retire(me))
+            break;
+    }
 
     pthread_exit(0);
 }
 
+// start a worker in a free slot, called with resize_lock held
+// returns 0 if successful or 1 otherwise
+static int spawn_bee(void)
+{
+    int n = atomic_load(&nr_slots);
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (bees[i].state != BEE_RUNNING)
+            break;
+    }
+    if (i == max_bees)
+        return 1;
+
+    if (bees[i].state == BEE_EXITED)
+        pthread_join(bees[i].thread, NULL);
+
+    bees[i].state = BEE_RUNNING;
+    if (i == n)
+        atomic_store(&nr_slots, n + 1);
+    if (pthread_create(&bees[i].thread, NULL, worker, &bees[i]) != 0) {
+        bees[i].state = BEE_UNUSED;
+        return 1;
+    }
+    atomic_fetch_add(&running_bees, 1);
+
+    return 0;
+}
+
+// add a worker if work is backing up and nobody is idle to take it.
+// called by submitters, so the common case is just a few loads.
+static void maybe_grow(size_t depth)
+{
+    if (!(pool_mode & POOL_DYNAMIC) || atomic_load(&idle_workers) > 0)
+        return;
+
+    if (depth <= (size_t)atomic_load(&running_bees) * GROW_THRESHOLD
+            || atomic_load(&running_bees) >= max_bees)
+        return;
+
+    // somebody else is already resizing
+    if (pthread_mutex_trylock(&resize_lock) != 0)
+        return;
+    if (!atomic_load(&shutting_down))
+        spawn_bee();
+    pthread_mutex_unlock(&resize_lock);
+}
+
+// number of tasks waiting in the shared lanes
+static size_t queue_depth(void)
+{
+    size_t depth = atomic_load_explicit(&edf_count, memory_order_relaxed);
+    int i;
+
+    for (i = 0; i < POOL_PRIORITIES; i++)
+        depth += atomic_load_explicit(&worktodo[i].enqueue_pos, memory_order_relaxed)
+            - atomic_load_explicit(&worktodo[i].dequeue_pos, memory_order_relaxed);
+
+    return depth;
+}
+
 /**
  * Executes the task provided to the thread pool
  */
@@ -58,25 +958,960 @@ void execute(void (*somefunction)(void *p), void *p)
     (*somefunction)(p);
 }
 
+// wake up to n idle workers
+static void wake_many(int n)
+{
+    while (n-- > 0 && atomic_load(&idle_workers) > 0)
+        wake_one();
+}
+
+// the submission time to stamp on a task, 0 if stats are off
+static long submit_time(void)
+{
+    if (!atomic_load_explicit(&stats_enabled, memory_order_relaxed))
+        return 0;
+
+    return stats_now();
+}
+
+// raise the shared queue's high-water mark
+static void note_depth(size_t depth)
+{
+    long high;
+
+    if (!atomic_load_explicit(&stats_enabled, memory_order_relaxed))
+        return;
+
+    high = atomic_load_explicit(&queue_high_water, memory_order_relaxed);
+    while ((long)depth > high) {
+        if (atomic_compare_exchange_weak_explicit(&queue_high_water, &high, (long)depth,
+                    memory_order_relaxed, memory_order_relaxed))
+            break;
+    }
+}
+
+// let the workers know about a task that was just queued
+static void submitted(int n)
+{
+    size_t depth;
+
+    // publish the task before looking for idle workers (see park())
+    atomic_thread_fence(memory_order_seq_cst);
+    wake_many(n);
+    depth = queue_depth();
+    maybe_grow(depth);
+    note_depth(depth);
+}
+
 /**
  * Submits work to the pool.
+ * returns 0 if successful or 1 if the queue is full or the pool stopped.
  */
 int pool_submit(void (*somefunction)(void *p), void *p)
 {
-    worktodo.function = somefunction;
-    worktodo.data = p;
+    return pool_submit_prio(somefunction, p, POOL_PRIO_NORMAL);
+}
+
+// announce a submit from outside the pool, which stop_workers waits
+// for after setting STOPPED, so that every task is either refused or
+// queued before the queues are emptied. workers need not: STOPPED is
+// only set once none of them is running.
+// returns 0 if the task may be queued or 1 if the pool stopped.
+static int submit_begin(void)
+{
+    if (self != NULL)
+        return 0;
+
+    atomic_fetch_add(&submitters, 1);
+    if (atomic_load(&shutting_down) == STOPPED) {
+        atomic_fetch_sub(&submitters, 1);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void submit_end(void)
+{
+    if (self == NULL)
+        atomic_fetch_sub(&submitters, 1);
+}
+
+/**
+ * Submits work to one of the priority lanes.
+ * returns 0 if successful or 1 if the lane is full, the priority is
+ * unknown or the pool stopped.
+ */
+int pool_submit_prio(void (*somefunction)(void *p), void *p, int prio)
+{
+    task t;
+    int full = 0;
+
+    if (prio < 0 || prio >= POOL_PRIORITIES)
+        return 1;
+    if (submit_begin() != 0)
+        return 1;
+
+    t.function = somefunction;
+    t.data = p;
+    t.queued = submit_time();
+
+    if (self != NULL && (pool_mode & POOL_WORK_STEALING) && prio == POOL_PRIO_NORMAL) {
+        // submitted from inside a task: keep it on this worker
+        task *local = slab_alloc();
+
+        *local = t;
+        if (deque_push(&self->dq, local) != 0) {
+            slab_free(local);
+            full = enqueue(&worktodo[prio], t) != 0;
+        }
+    }
+    else {
+        full = enqueue(&worktodo[prio], t) != 0;
+    }
+    submit_end();
+
+    if (full)
+        return 1;
+
+    submitted(1);
 
     return 0;
 }
 
-// initialize the thread pool
+/**
+ * Submits work to the earliest-deadline-first lane. deadline is an
+ * absolute CLOCK_MONOTONIC time; overdue tasks still run, first.
+ * returns 0 if successful or 1 if out of memory or the pool stopped.
+ */
+int pool_submit_deadline(void (*somefunction)(void *p), void *p,
+                         const struct timespec *deadline)
+{
+    task t;
+    int full;
+
+    if (submit_begin() != 0)
+        return 1;
+
+    t.function = somefunction;
+    t.data = p;
+    t.queued = submit_time();
+
+    full = edf_insert(deadline->tv_sec * 1000000000L + deadline->tv_nsec, t) != 0;
+    submit_end();
+
+    if (full)
+        return 1;
+
+    submitted(1);
+
+    return 0;
+}
+
+/**
+ * Submits n tasks, each running somefunction on one of params[].
+ * Either all of them are queued or none are.
+ * returns 0 if successful or 1 if the queue is full or the pool stopped.
+ */
+int pool_submit_batch(void (*somefunction)(void *p), void *params[], int n)
+{
+    long queued = submit_time();
+    int full = 0;
+
+    if (submit_begin() != 0)
+        return 1;
+    if (n <= 0) {
+        submit_end();
+        return 0;
+    }
+
+    if (self == NULL || !(pool_mode & POOL_WORK_STEALING)
+            || deque_push_batch(&self->dq, somefunction, params, n, queued) != 0)
+        full = enqueue_batch(&worktodo[POOL_PRIO_NORMAL], somefunction, params, n, queued) != 0;
+    submit_end();
+
+    if (full)
+        return 1;
+
+    submitted(n);
+
+    return 0;
+}
+
+// mark a future done or cancelled, waking anybody blocked on it
+static void future_settle(struct pool_future *f, int state)
+{
+    int expected = FUTURE_PENDING;
+
+    if (!atomic_compare_exchange_strong(&f->state, &expected, state)) {
+        // somebody is asleep waiting for us
+        pthread_mutex_lock(&f->lock);
+        atomic_store(&f->state, state);
+        pthread_cond_broadcast(&f->done);
+        pthread_mutex_unlock(&f->lock);
+    }
+}
+
+static void future_complete(struct pool_future *f)
+{
+    future_settle(f, FUTURE_DONE);
+}
+
+// set up a future that has not completed
+static void future_init(struct pool_future *f, void *(*somefunction)(void *p), void *p)
+{
+    f->function = somefunction;
+    f->data = p;
+    f->result = NULL;
+    atomic_init(&f->state, FUTURE_PENDING);
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->done, NULL);
+}
+
+// runs the function behind a future and publishes its result
+static void run_future(void *p)
+{
+    struct pool_future *f = p;
+
+    f->result = (*f->function)(f->data);
+    future_complete(f);
+}
+
+/**
+ * Submits work that produces a result.
+ * returns a future to wait on, or NULL if the queue is full.
+ */
+struct pool_future *pool_submit_future(void *(*somefunction)(void *p), void *p)
+{
+    struct pool_future *f = malloc(sizeof(struct pool_future));
+
+    if (f == NULL)
+        return NULL;
+
+    future_init(f, somefunction, p);
+
+    if (pool_submit(&run_future, f) != 0) {
+        pool_future_destroy(f);
+        return NULL;
+    }
+
+    return f;
+}
+
+// returns 1 if the future has completed or was cancelled, or 0 otherwise
+int pool_future_poll(struct pool_future *f)
+{
+    return atomic_load(&f->state) >= FUTURE_DONE;
+}
+
+// returns 1 if a stop discarded the future's task before it ran, so
+// that its result is NULL, or 0 otherwise
+int pool_future_cancelled(struct pool_future *f)
+{
+    return atomic_load(&f->state) == FUTURE_CANCELLED;
+}
+
+// block until the future has completed
+void pool_future_wait(struct pool_future *f)
+{
+    int expected = FUTURE_PENDING;
+    task t;
+
+    // a worker waiting on a future keeps running other tasks, so that
+    // tasks waiting on tasks cannot starve the pool of workers
+    while (self != NULL && !pool_future_poll(f)
+            && atomic_load(&shutting_down) != SHUTDOWN_NOW
+            && find_work(self, &t) == 0)
+        run_task(self, &t);
+
+    if (pool_future_poll(f))
+        return;
+
+    pthread_mutex_lock(&f->lock);
+    if (atomic_compare_exchange_strong(&f->state, &expected, FUTURE_WAITING)
+            || expected == FUTURE_WAITING) {
+        while (atomic_load(&f->state) == FUTURE_WAITING)
+            pthread_cond_wait(&f->done, &f->lock);
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+// block until the future has completed and return its result, or NULL
+// if it was cancelled
+void *pool_future_result(struct pool_future *f)
+{
+    pool_future_wait(f);
+
+    return f->result;
+}
+
+// release the synchronization behind a completed future
+static void future_fini(struct pool_future *f)
+{
+    // wait for the completing worker to let go of the lock
+    pthread_mutex_lock(&f->lock);
+    pthread_mutex_unlock(&f->lock);
+
+    pthread_cond_destroy(&f->done);
+    pthread_mutex_destroy(&f->lock);
+}
+
+// release a future, which must have completed or never been queued
+void pool_future_destroy(struct pool_future *f)
+{
+    future_fini(f);
+    free(f);
+}
+
+// create an empty task graph
+// returns NULL if out of memory
+struct pool_graph *pool_graph_create(void)
+{
+    struct pool_graph *g = malloc(sizeof(struct pool_graph));
+
+    if (g == NULL)
+        return NULL;
+
+    g->nodes = NULL;
+    g->count = 0;
+    atomic_init(&g->remaining, 0);
+    atomic_init(&g->cancelled, 0);
+    future_init(&g->done, NULL, NULL);
+
+    return g;
+}
+
+// add a task to a graph that has not been run yet
+// returns the new node, or NULL if out of memory
+struct pool_node *pool_graph_node(struct pool_graph *g, void (*somefunction)(void *p), void *p)
+{
+    struct pool_node *n = malloc(sizeof(struct pool_node));
+
+    if (n == NULL)
+        return NULL;
+
+    n->function = somefunction;
+    n->data = p;
+    atomic_init(&n->deps, 1);
+    n->succ = NULL;
+    n->nsucc = 0;
+    n->succ_size = 0;
+    n->graph = g;
+    n->next = g->nodes;
+    g->nodes = n;
+    g->count++;
+
+    return n;
+}
+
+// make after run once before has completed
+// returns 0 if successful or 1 if the nodes are in different graphs
+// or out of memory
+int pool_graph_then(struct pool_node *before, struct pool_node *after)
+{
+    if (before->graph != after->graph)
+        return 1;
+
+    if (before->nsucc == before->succ_size) {
+        int size = before->succ_size ? before->succ_size * 2 : 4;
+        struct pool_node **grown = realloc(before->succ, sizeof(struct pool_node *) * size);
+
+        if (grown == NULL)
+            return 1;
+        before->succ = grown;
+        before->succ_size = size;
+    }
+
+    before->succ[before->nsucc++] = after;
+    atomic_fetch_add_explicit(&after->deps, 1, memory_order_relaxed);
+
+    return 0;
+}
+
+// drop one of a node's dependencies
+// returns 1 if that made the node ready to run or 0 otherwise
+static int release(struct pool_node *n)
+{
+    return atomic_fetch_sub_explicit(&n->deps, 1, memory_order_acq_rel) == 1;
+}
+
+static void run_node(void *p);
+
+// queue a ready node, or run it here if the queue is full
+static void submit_node(struct pool_node *n)
+{
+    if (pool_submit(&run_node, n) != 0)
+        run_node(n);
+}
+
+// run a node, then keep running the first successor each one makes
+// ready on this worker and hand any others to the pool
+static void run_node(void *p)
+{
+    struct pool_node *n = p;
+    struct pool_graph *g = n->graph;
+
+    while (n != NULL) {
+        struct pool_node *inline_next = NULL;
+        int i;
+
+        (*n->function)(n->data);
+
+        for (i = 0; i < n->nsucc; i++) {
+            if (!release(n->succ[i]))
+                continue;
+            if (inline_next == NULL)
+                inline_next = n->succ[i];
+            else
+                submit_node(n->succ[i]);
+        }
+
+        // the graph may be freed as soon as the last node is counted
+        if (atomic_fetch_sub_explicit(&g->remaining, 1, memory_order_acq_rel) == 1)
+            future_settle(&g->done, atomic_load(&g->cancelled) ? FUTURE_CANCELLED : FUTURE_DONE);
+
+        n = inline_next;
+    }
+}
+
+// count a node a stop took off the queue as finished without running
+// it, along with every successor that can now never run, so that the
+// graph still settles once its running nodes are done
+static void discard_node(struct pool_node *n)
+{
+    struct pool_graph *g = n->graph;
+    int i;
+
+    atomic_store(&g->cancelled, 1);
+
+    for (i = 0; i < n->nsucc; i++) {
+        if (release(n->succ[i]))
+            discard_node(n->succ[i]);
+    }
+
+    if (atomic_fetch_sub_explicit(&g->remaining, 1, memory_order_acq_rel) == 1)
+        future_settle(&g->done, FUTURE_CANCELLED);
+}
+
+// start every node whose predecessors are all done; a graph runs once
+void pool_graph_run(struct pool_graph *g)
+{
+    struct pool_node *n, *next;
+
+    if (g->count == 0) {
+        future_complete(&g->done);
+        return;
+    }
+
+    atomic_store(&g->remaining, g->count);
+
+    // the last release may start a node that completes the graph,
+    // so read the list before letting go of each node
+    for (n = g->nodes; n != NULL; n = next) {
+        next = n->next;
+        if (release(n))
+            submit_node(n);
+    }
+}
+
+// block until every node in the graph has run, or a stop discarded
+// some of them
+void pool_graph_wait(struct pool_graph *g)
+{
+    pool_future_wait(&g->done);
+}
+
+// returns 1 if a stop discarded some of the graph's nodes, or 0 otherwise
+int pool_graph_cancelled(struct pool_graph *g)
+{
+    return pool_future_cancelled(&g->done);
+}
+
+// release a graph, which must have completed or never been run
+void pool_graph_destroy(struct pool_graph *g)
+{
+    struct pool_node *n, *next;
+
+    for (n = g->nodes; n != NULL; n = next) {
+        next = n->next;
+        free(n->succ);
+        free(n);
+    }
+
+    future_fini(&g->done);
+    free(g);
+}
+
+// initialize the thread pool with a single shared queue
 void pool_init(void)
 {
-    pthread_create(&bee,NULL,worker,NULL);
+    pool_init_mode(POOL_SHARED_QUEUE);
+}
+
+// initialize the thread pool in the given mode
+void pool_init_mode(int mode)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int cpu[MAX_THREADS], node[MAX_THREADS];
+    size_t i;
+
+    int weights[POOL_PRIORITIES] = LANE_WEIGHTS;
+    int credit[POOL_PRIORITIES] = { 0 };
+    int lane, turn;
+
+    for (lane = 0; lane < POOL_PRIORITIES; lane++) {
+        for (i = 0; i < QUEUE_SIZE; i++)
+            atomic_init(&worktodo[lane].slots[i].seq, i);
+        atomic_init(&worktodo[lane].enqueue_pos, 0);
+        atomic_init(&worktodo[lane].dequeue_pos, 0);
+    }
+    atomic_init(&edf_count, 0);
+
+    // smooth weighted round-robin: spread each lane's turns
+    // evenly through the cycle rather than in one run
+    for (turn = 0; turn < LANE_CYCLE; turn++) {
+        int best = 0;
+
+        for (lane = 0; lane < POOL_PRIORITIES; lane++) {
+            credit[lane] += weights[lane];
+            if (credit[lane] > credit[best])
+                best = lane;
+        }
+        credit[best] -= LANE_CYCLE;
+        lane_order[turn] = best;
+    }
+    atomic_init(&idle_workers, 0);
+    atomic_init(&shutting_down, RUNNING);
+    sem_init(&wakeup, 0, 0);
+    pool_mode = mode;
+
+    // in dynamic mode grow to one worker per CPU, but never below
+    // the fixed pool size
+    max_bees = NUMBER_OF_THREADS;
+    if ((mode & POOL_DYNAMIC) && cpus > max_bees)
+        max_bees = cpus < MAX_THREADS ? cpus : MAX_THREADS;
+
+    if (affinity_plan(affinity_policy, affinity_cpus, affinity_ncpus,
+                      MAX_THREADS, cpu, node) != 0)
+        affinity_plan(POOL_AFFINITY_NONE, NULL, 0, MAX_THREADS, cpu, node);
+
+    for (i = 0; i < MAX_THREADS; i++) {
+        atomic_init(&bees[i].dq.top, 0);
+        atomic_init(&bees[i].dq.bottom, 0);
+        bees[i].dq.buf = NULL;
+        bees[i].state = BEE_UNUSED;
+        bees[i].cpu = cpu[i];
+        bees[i].node = node[i];
+        bees[i].seed = 2463534242u + i;
+        bees[i].lane_turn = i % LANE_CYCLE;
+        atomic_init(&bees[i].steals_same_node, 0);
+        atomic_init(&bees[i].steals_cross_node, 0);
+        atomic_init(&bees[i].tasks, 0);
+        atomic_init(&bees[i].parks, 0);
+        hist_reset(&bees[i].wait);
+        hist_reset(&bees[i].run);
+    }
+    atomic_init(&queue_high_water, 0);
+    atomic_init(&nr_slots, 0);
+    atomic_init(&running_bees, 0);
+
+    pthread_mutex_lock(&resize_lock);
+    for (i = 0; i < NUMBER_OF_THREADS; i++)
+        spawn_bee();
+    pthread_mutex_unlock(&resize_lock);
+}
+
+/**
+ * Chooses where workers run: POOL_AFFINITY_NONE leaves them to the
+ * scheduler, POOL_AFFINITY_COMPACT fills one NUMA node's CPUs before
+ * the next, POOL_AFFINITY_SCATTER deals workers out across nodes, and
+ * POOL_AFFINITY_LIST pins worker i to cpus[i % ncpus].
+ * Takes effect at the next pool_init.
+ * returns 0 if successful or 1 if the policy is unknown.
+ */
+int pool_set_affinity(int policy, const int *cpus, int ncpus)
+{
+    int *copy = NULL;
+    int i;
+
+    if (policy < POOL_AFFINITY_NONE || policy > POOL_AFFINITY_LIST)
+        return 1;
+    if (policy == POOL_AFFINITY_LIST) {
+        if (cpus == NULL || ncpus <= 0)
+            return 1;
+        if ((copy = malloc(sizeof(int) * ncpus)) == NULL)
+            return 1;
+        for (i = 0; i < ncpus; i++)
+            copy[i] = cpus[i];
+    }
+
+    free(affinity_cpus);
+    affinity_cpus = copy;
+    affinity_ncpus = ncpus;
+    affinity_policy = policy;
+
+    return 0;
+}
+
+// total steals that stayed within a NUMA node and that crossed nodes
+void pool_steal_counts(long *same_node, long *cross_node)
+{
+    int i;
+
+    *same_node = 0;
+    *cross_node = 0;
+    for (i = 0; i < MAX_THREADS; i++) {
+        *same_node += atomic_load_explicit(&bees[i].steals_same_node, memory_order_relaxed);
+        *cross_node += atomic_load_explicit(&bees[i].steals_cross_node, memory_order_relaxed);
+    }
+}
+
+// slab refills by any thread, and batches of task records freed by a
+// worker other than the one that allocated them
+void pool_alloc_counters(long *refills, long *remote_batches)
+{
+    slab_counters(refills, remote_batches);
 }
 
-// shutdown the thread pool
+// turn statistics on or off; they start off
+void pool_stats_enable(int on)
+{
+    atomic_store(&stats_enabled, on != 0);
+}
+
+// take a snapshot of the statistics, merging every worker's counters
+void pool_stats(struct pool_stats *out)
+{
+    long wait[HIST_BUCKETS] = { 0 };
+    long run[HIST_BUCKETS] = { 0 };
+    int i;
+
+    out->workers = atomic_load(&nr_slots);
+    out->tasks = 0;
+    for (i = 0; i < out->workers; i++) {
+        struct bee *b = &bees[i];
+
+        out->worker[i].tasks = atomic_load_explicit(&b->tasks, memory_order_relaxed);
+        out->worker[i].steals = atomic_load_explicit(&b->steals_same_node, memory_order_relaxed)
+            + atomic_load_explicit(&b->steals_cross_node, memory_order_relaxed);
+        out->worker[i].parks = atomic_load_explicit(&b->parks, memory_order_relaxed);
+        out->tasks += out->worker[i].tasks;
+        hist_merge(wait, &b->wait);
+        hist_merge(run, &b->run);
+    }
+    out->queue_high_water = atomic_load_explicit(&queue_high_water, memory_order_relaxed);
+
+    out->wait_p50 = hist_percentile(wait, 0.50);
+    out->wait_p99 = hist_percentile(wait, 0.99);
+    out->wait_p999 = hist_percentile(wait, 0.999);
+    out->wait_max = hist_max(wait);
+    out->run_p50 = hist_percentile(run, 0.50);
+    out->run_p99 = hist_percentile(run, 0.99);
+    out->run_p999 = hist_percentile(run, 0.999);
+    out->run_max = hist_max(run);
+}
+
+// print a snapshot in a human readable form
+void pool_stats_print(FILE *out, const struct pool_stats *s)
+{
+    int i;
+
+    fprintf(out, "tasks %ld, queue high water %ld\n", s->tasks, s->queue_high_water);
+    fprintf(out, "wait ns: p50 %ld p99 %ld p99.9 %ld max %ld\n",
+            s->wait_p50, s->wait_p99, s->wait_p999, s->wait_max);
+    fprintf(out, "run ns:  p50 %ld p99 %ld p99.9 %ld max %ld\n",
+            s->run_p50, s->run_p99, s->run_p999, s->run_max);
+    for (i = 0; i < s->workers; i++)
+        fprintf(out, "worker %d: tasks %ld steals %ld parks %ld\n", i,
+                s->worker[i].tasks, s->worker[i].steals, s->worker[i].parks);
+}
+
+static void print_to_stderr(const struct pool_stats *s)
+{
+    pool_stats_print(stderr, s);
+}
+
+// hand a snapshot to the dump hook every dump_interval_ms
+static void *dumper(void *param)
+{
+    struct pool_stats snapshot;
+    struct timespec next;
+
+    pthread_mutex_lock(&dump_lock);
+    clock_gettime(CLOCK_REALTIME, &next);
+    while (dump_running) {
+        next.tv_sec += dump_interval_ms / 1000;
+        next.tv_nsec += (dump_interval_ms % 1000) * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        while (dump_running && pthread_cond_timedwait(&dump_stop, &dump_lock, &next) == 0)
+            ;
+        if (!dump_running)
+            break;
+
+        pool_stats(&snapshot);
+        (*dump_hook)(&snapshot);
+    }
+    pthread_mutex_unlock(&dump_lock);
+
+    return NULL;
+}
+
+// stop the periodic dump, if it is running
+static void stop_dump(void)
+{
+    int running;
+
+    pthread_mutex_lock(&dump_lock);
+    running = dump_running;
+    dump_running = 0;
+    pthread_cond_signal(&dump_stop);
+    pthread_mutex_unlock(&dump_lock);
+
+    if (running)
+        pthread_join(dump_thread, NULL);
+}
+
+/**
+ * Calls hook with a fresh snapshot every interval_ms until the pool is
+ * shut down; a NULL hook prints to stderr. An interval of 0 stops it.
+ * Also switches statistics on.
+ * returns 0 if successful or 1 otherwise.
+ */
+int pool_stats_dump_every(int interval_ms, void (*hook)(const struct pool_stats *s))
+{
+    stop_dump();
+    if (interval_ms <= 0)
+        return 0;
+
+    pool_stats_enable(1);
+
+    pthread_mutex_lock(&dump_lock);
+    dump_interval_ms = interval_ms;
+    dump_hook = hook != NULL ? hook : &print_to_stderr;
+    dump_running = 1;
+    if (pthread_create(&dump_thread, NULL, dumper, NULL) != 0)
+        dump_running = 0;
+    pthread_mutex_unlock(&dump_lock);
+
+    return !dump_running;
+}
+
+// returns 1 once the pool has been told to stop now, so that long
+// running tasks can give up early, or 0 otherwise
+int pool_cancelled(void)
+{
+    return atomic_load_explicit(&shutting_down, memory_order_relaxed) == SHUTDOWN_NOW;
+}
+
+// append a task to a growing array of pending tasks
+static void add_pending(struct pool_task **pending, int *n, int *size, task t)
+{
+    struct pool_task work;
+
+    if (*n == *size) {
+        struct pool_task *grown;
+
+        *size = *size ? *size * 2 : QUEUE_SIZE;
+        grown = realloc(*pending, sizeof(struct pool_task) * *size);
+        if (grown == NULL) {
+            fprintf(stderr, "threadpool: out of memory collecting pending tasks\n");
+            exit(EXIT_FAILURE);
+        }
+        *pending = grown;
+    }
+    work.function = t.function;
+    work.data = t.data;
+    (*pending)[(*n)++] = work;
+}
+
+// take one task off any queue; safe while workers are still running
+// returns 0 if successful or 1 if every queue is empty
+static int take_task(task *t)
+{
+    int i;
+
+    if (edf_take(t) == 0)
+        return 0;
+    for (i = 0; i < POOL_PRIORITIES; i++) {
+        if (dequeue(&worktodo[i], t) == 0)
+            return 0;
+    }
+
+    for (i = 0; i < atomic_load(&nr_slots); i++) {
+        struct deque *dq = &bees[i].dq;
+        task *local;
+
+        // a failed steal lost the task to its owner or another thief
+        while (deque_pending(dq)) {
+            if ((local = deque_steal(dq)) != NULL) {
+                *t = *local;
+                slab_free(local);
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// take every queued task that will now never run. futures and graphs
+// behind them are cancelled, waking anybody waiting on them; the rest
+// are appended to *pending.
+static void discard_queued(struct pool_task **pending, int *n, int *size)
+{
+    task t;
+
+    while (take_task(&t) == 0) {
+        if (t.function == &run_future)
+            future_settle(t.data, FUTURE_CANCELLED);
+        else if (t.function == &run_node)
+            discard_node(t.data);
+        else
+            add_pending(pending, n, size, t);
+    }
+}
+
+// wait a moment for a worker to exit
+// returns 0 if it did or an error number otherwise
+static int join_soon(pthread_t thread)
+{
+    struct timespec soon;
+
+    clock_gettime(CLOCK_REALTIME, &soon);
+    soon.tv_nsec += 1000000;
+    if (soon.tv_nsec >= 1000000000L) {
+        soon.tv_sec++;
+        soon.tv_nsec -= 1000000000L;
+    }
+
+    return pthread_timedjoin_np(thread, NULL, &soon);
+}
+
+// stop the workers and wait for them to exit.
+// with a deadline, a drain turns into a stop once the deadline passes.
+// with pending NULL, tasks queued too late for the workers are run
+// here; otherwise tasks that never ran are stored in *pending, and the
+// return value is how many there are.
+static int stop_workers(int how, const struct timespec *deadline, struct pool_task **pending)
+{
+    int n = 0, size = 0;
+    int i;
+    task t;
+
+    if (pending != NULL)
+        *pending = NULL;
+
+    stop_dump();
+
+    atomic_store(&shutting_down, how);
+    wake_many(MAX_THREADS);
+
+    // once shutting_down is set no worker can be added, so after
+    // passing through the lock the set of slots is final. retiring
+    // workers still take the lock, so do not hold it while joining.
+    for (i = 0; i < atomic_load(&nr_slots); i++) {
+        int state;
+
+        pthread_mutex_lock(&resize_lock);
+        state = bees[i].state;
+        bees[i].state = BEE_UNUSED;
+        pthread_mutex_unlock(&resize_lock);
+
+        if (state == BEE_UNUSED)
+            continue;
+
+        if (deadline != NULL && how == SHUTDOWN_DRAIN
+                && pthread_timedjoin_np(bees[i].thread, NULL, deadline) == 0)
+            continue;
+
+        if (deadline != NULL && how == SHUTDOWN_DRAIN) {
+            // out of time, stop the rest without draining
+            how = SHUTDOWN_NOW;
+            atomic_store(&shutting_down, how);
+            wake_many(MAX_THREADS);
+        }
+
+        if (how == SHUTDOWN_DRAIN) {
+            pthread_join(bees[i].thread, NULL);
+            continue;
+        }
+
+        // a running task may be blocked on a future or graph whose task
+        // is still queued; keep cancelling those until the worker exits
+        while (join_soon(bees[i].thread) != 0)
+            discard_queued(pending, &n, &size);
+    }
+
+    // a submitter from outside either sees STOPPED and gives up, or is
+    // waited for here and its task is in a queue below
+    atomic_store(&shutting_down, STOPPED);
+    while (atomic_load(&submitters) > 0)
+        sched_yield();
+
+    if (pending == NULL) {
+        while (take_task(&t) == 0)
+            (*t.function)(t.data);
+    }
+    else {
+        discard_queued(pending, &n, &size);
+    }
+    slab_flush();
+    sem_destroy(&wakeup);
+
+    return n;
+}
+
+// shutdown the thread pool, after all submitted work has run
 void pool_shutdown(void)
 {
-    pthread_join(bee,NULL);
+    pool_shutdown_drain();
+}
+
+// release the workers' deques, once they are empty
+static void free_deques(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_THREADS; i++) {
+        free(bees[i].dq.buf);
+        bees[i].dq.buf = NULL;
+    }
+}
+
+// shutdown the thread pool, after all submitted work has run
+void pool_shutdown_drain(void)
+{
+    stop_workers(SHUTDOWN_DRAIN, NULL, NULL);
+    free_deques();
+}
+
+// shutdown the thread pool once running tasks finish.
+// tasks that never started are returned in *pending, which the caller
+// must free; returns how many there are. futures and graph nodes that
+// never started are not returned but cancelled, see
+// pool_future_cancelled and pool_graph_cancelled.
+int pool_shutdown_now(struct pool_task **pending)
+{
+    int n;
+
+    n = stop_workers(SHUTDOWN_NOW, NULL, pending);
+    free_deques();
+
+    return n;
+}
+
+// drain the thread pool until the absolute CLOCK_REALTIME deadline,
+// then stop as pool_shutdown_now does. returns the number of tasks in
+// *pending, which the caller must free.
+int pool_shutdown_deadline(const struct timespec *deadline, struct pool_task **pending)
+{
+    int n;
+
+    n = stop_workers(SHUTDOWN_DRAIN, deadline, pending);
+    free_deques();
+
+    return n;
 }
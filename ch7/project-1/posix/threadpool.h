@@ -1,6 +1,93 @@
+#include <stdio.h>
+#include <time.h>
+
+// pool modes, selected at pool_init_mode time
+#define POOL_SHARED_QUEUE 0
+#define POOL_WORK_STEALING 1
+
+// may be or'ed with either mode to size the pool to the load
+#define POOL_DYNAMIC 2
+
+// priority lanes for pool_submit_prio; pool_submit uses normal
+#define POOL_PRIO_HIGH 0
+#define POOL_PRIO_NORMAL 1
+#define POOL_PRIO_LOW 2
+#define POOL_PRIORITIES 3
+
+// the most workers a pool can have
+#define POOL_MAX_WORKERS 64
+
+// a unit of work, as handed back by pool_shutdown_now
+struct pool_task
+{
+    void (*function)(void *p);
+    void *data;
+};
+
+// worker placement policies, see pool_set_affinity
+#define POOL_AFFINITY_NONE 0
+#define POOL_AFFINITY_COMPACT 1
+#define POOL_AFFINITY_SCATTER 2
+#define POOL_AFFINITY_LIST 3
+
+// per-worker counters in struct pool_stats
+struct pool_worker_stats
+{
+    long tasks;     // tasks run
+    long steals;    // tasks taken from other workers' deques
+    long parks;     // times the worker went to sleep
+};
+
+// a snapshot of the pool, see pool_stats; latencies are in nanoseconds
+struct pool_stats
+{
+    int workers;
+    struct pool_worker_stats worker[POOL_MAX_WORKERS];
+    long tasks;
+    long queue_high_water;  // deepest the shared queue has been
+    long wait_p50, wait_p99, wait_p999, wait_max;   // submit to start
+    long run_p50, run_p99, run_p999, run_max;       // start to finish
+};
+
+// the result of a task submitted with pool_submit_future
+struct pool_future;
+
+// a set of tasks with "runs after" edges, and one task in it
+struct pool_graph;
+struct pool_node;
+
 // function prototypes
 void execute(void (*somefunction)(void *p), void *p);
 int pool_submit(void (*somefunction)(void *p), void *p);
+int pool_submit_prio(void (*somefunction)(void *p), void *p, int prio);
+int pool_submit_deadline(void (*somefunction)(void *p), void *p,
+                         const struct timespec *deadline);
+int pool_submit_batch(void (*somefunction)(void *p), void *params[], int n);
+struct pool_future *pool_submit_future(void *(*somefunction)(void *p), void *p);
+int pool_future_poll(struct pool_future *f);
+int pool_future_cancelled(struct pool_future *f);
+void pool_future_wait(struct pool_future *f);
+void *pool_future_result(struct pool_future *f);
+void pool_future_destroy(struct pool_future *f);
+struct pool_graph *pool_graph_create(void);
+struct pool_node *pool_graph_node(struct pool_graph *g, void (*somefunction)(void *p), void *p);
+int pool_graph_then(struct pool_node *before, struct pool_node *after);
+void pool_graph_run(struct pool_graph *g);
+void pool_graph_wait(struct pool_graph *g);
+int pool_graph_cancelled(struct pool_graph *g);
+void pool_graph_destroy(struct pool_graph *g);
 void *worker(void *param);
 void pool_init(void);
+void pool_init_mode(int mode);
 void pool_shutdown(void);
+void pool_shutdown_drain(void);
+int pool_shutdown_now(struct pool_task **pending);
+int pool_shutdown_deadline(const struct timespec *deadline, struct pool_task **pending);
+int pool_cancelled(void);
+int pool_set_affinity(int policy, const int *cpus, int ncpus);
+void pool_steal_counts(long *same_node, long *cross_node);
+void pool_alloc_counters(long *refills, long *remote_batches);
+void pool_stats_enable(int on);
+void pool_stats(struct pool_stats *out);
+void pool_stats_print(FILE *out, const struct pool_stats *s);
+int pool_stats_dump_every(int interval_ms, void (*hook)(const struct pool_stats *s));